@@ -0,0 +1,138 @@
+/*
+ * obs-gstreamer. OBS Studio plugin.
+ * Copyright (C) 2018-2021 Florian Zwoch <fzwoch@gmail.com>
+ *
+ * This file is part of obs-gstreamer.
+ *
+ * obs-gstreamer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * obs-gstreamer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obs-gstreamer. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <obs/obs-module.h>
+#include <gst/gst.h>
+#include <gst/net/gstnet.h>
+#include <obs/util/platform.h>
+
+#include "gstreamer-clock.h"
+
+// NTP clocks are shared by all pipelines using the same server, so the
+// clock syncs once in the background instead of once per pipeline start
+typedef struct {
+	GstClock *clock;
+	guint ref;
+} ntp_clock_t;
+
+static GMutex ntp_clocks_mutex;
+static GHashTable *ntp_clocks;
+
+GstClock *gstreamer_ntp_clock_acquire(const char *server, gint port)
+{
+	gchar *key = g_strdup_printf("%s:%d", server, port);
+
+	g_mutex_lock(&ntp_clocks_mutex);
+
+	if (ntp_clocks == NULL)
+		ntp_clocks = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	ntp_clock_t *entry = g_hash_table_lookup(ntp_clocks, key);
+	if (entry == NULL) {
+		GstClock *clock = gst_ntp_clock_new("net_clock", server, port, 0);
+		if (clock == NULL) {
+			g_mutex_unlock(&ntp_clocks_mutex);
+			g_free(key);
+			return NULL;
+		}
+
+		blog(LOG_INFO, "Connect to NTP server %s", key);
+
+		entry = g_new0(ntp_clock_t, 1);
+		entry->clock = clock;
+		g_hash_table_insert(ntp_clocks, key, entry);
+	} else {
+		g_free(key);
+	}
+
+	entry->ref++;
+	GstClock *clock = gst_object_ref(entry->clock);
+
+	g_mutex_unlock(&ntp_clocks_mutex);
+
+	return clock;
+}
+
+void gstreamer_ntp_clock_release(gpointer clock)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_mutex_lock(&ntp_clocks_mutex);
+
+	g_hash_table_iter_init(&iter, ntp_clocks);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		ntp_clock_t *entry = value;
+
+		if (entry->clock != clock)
+			continue;
+
+		if (--entry->ref == 0) {
+			gst_object_unref(entry->clock);
+			g_hash_table_iter_remove(&iter);
+			g_free(entry);
+		}
+		break;
+	}
+
+	g_mutex_unlock(&ntp_clocks_mutex);
+
+	gst_object_unref(clock);
+}
+
+// a system clock reading os_gettime_ns(). running time plus base time of a
+// pipeline on this clock is OBS time, so samples need no offset or drift
+// compensation in OBS.
+typedef struct {
+	GstSystemClock parent;
+} ObsGstreamerClock;
+
+typedef struct {
+	GstSystemClockClass parent_class;
+} ObsGstreamerClockClass;
+
+G_DEFINE_TYPE(ObsGstreamerClock, obs_gstreamer_clock, GST_TYPE_SYSTEM_CLOCK)
+
+static GstClockTime obs_gstreamer_clock_get_internal_time(GstClock *clock)
+{
+	return os_gettime_ns();
+}
+
+static void obs_gstreamer_clock_class_init(ObsGstreamerClockClass *klass)
+{
+	GST_CLOCK_CLASS(klass)->get_internal_time = obs_gstreamer_clock_get_internal_time;
+}
+
+static void obs_gstreamer_clock_init(ObsGstreamerClock *clock)
+{
+}
+
+GstClock *gstreamer_obs_clock_get(void)
+{
+	static GstClock *obs_clock;
+
+	if (g_once_init_enter(&obs_clock)) {
+		GstClock *clock = g_object_new(obs_gstreamer_clock_get_type(), "name", "obs_clock", NULL);
+		gst_object_ref_sink(clock);
+		g_once_init_leave(&obs_clock, clock);
+	}
+
+	return gst_object_ref(obs_clock);
+}
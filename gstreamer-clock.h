@@ -0,0 +1,32 @@
+/*
+ * obs-gstreamer. OBS Studio plugin.
+ * Copyright (C) 2018-2021 Florian Zwoch <fzwoch@gmail.com>
+ *
+ * This file is part of obs-gstreamer.
+ *
+ * obs-gstreamer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * obs-gstreamer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obs-gstreamer. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GSTREAMER_CLOCK_H
+#define GSTREAMER_CLOCK_H
+
+#include <gst/gst.h>
+
+// NTP clocks shared by all pipelines using the same server, and a clock
+// running on OBS time
+GstClock *gstreamer_ntp_clock_acquire(const char *server, gint port);
+void gstreamer_ntp_clock_release(gpointer clock);
+GstClock *gstreamer_obs_clock_get(void);
+
+#endif
@@ -26,6 +26,17 @@
 #include <gst/gst.h>
 #include <gst/app/app.h>
 
+#include "gstreamer-stats.h"
+
+// frames in flight, to match encoded packets to the time their frame went in
+#define ENCODE_TIMES 64
+
+// typed copy of the settings used by the encode path. encoders are not
+// updated at runtime, so the snapshot is taken once on create
+typedef struct {
+	bool force_copy;
+} config_t;
+
 typedef struct {
 	GstElement *pipe;
 	GstElement *appsrc;
@@ -37,7 +48,14 @@ typedef struct {
 	GstMapInfo info;
 	obs_encoder_t *encoder;
 	obs_data_t *settings;
+	config_t config;
 	struct obs_video_info ovi;
+	gstreamer_stats_t stats;
+	struct {
+		GstClockTime pts;
+		gint64 time;
+	} encode_times[ENCODE_TIMES];
+	guint encode_times_index;
 } data_t;
 
 const char *gstreamer_encoder_get_name_h264(void *type_data)
@@ -105,6 +123,9 @@ void *gstreamer_encoder_create_h264(obs_data_t *settings, obs_encoder_t *encoder
 
 	data->encoder = encoder;
 	data->settings = settings;
+	data->config.force_copy = obs_data_get_bool(settings, "force_copy");
+
+	gstreamer_stats_init(&data->stats);
 
 	obs_get_video_info(&data->ovi);
 
@@ -196,6 +217,9 @@ void *gstreamer_encoder_create_h265(obs_data_t *settings, obs_encoder_t *encoder
 
 	data->encoder = encoder;
 	data->settings = settings;
+	data->config.force_copy = obs_data_get_bool(settings, "force_copy");
+
+	gstreamer_stats_init(&data->stats);
 
 	obs_get_video_info(&data->ovi);
 
@@ -281,6 +305,8 @@ void gstreamer_encoder_destroy(void *p)
 		gst_sample_unref(data->sample);
 	}
 
+	gstreamer_stats_clear(&data->stats);
+
 	g_free(data->codec_data);
 	g_free(data);
 }
@@ -300,7 +326,7 @@ bool gstreamer_encoder_encode(void *p, struct encoder_frame *frame, struct encod
 
 	GstBuffer *buffer;
 
-	if (obs_data_get_bool(data->settings, "force_copy") == true) {
+	if (data->config.force_copy) {
 		buffer = gst_buffer_new_allocate(NULL, data->buffer_size, NULL);
 
 		gint32 offset = 0;
@@ -317,7 +343,17 @@ bool gstreamer_encoder_encode(void *p, struct encoder_frame *frame, struct encod
 	}
 	GST_BUFFER_PTS(buffer) = frame->pts * (GST_SECOND / (data->ovi.fps_num / data->ovi.fps_den));
 
-	gst_app_src_push_buffer(GST_APP_SRC(data->appsrc), buffer);
+	guint index = data->encode_times_index++ % ENCODE_TIMES;
+	data->encode_times[index].pts = GST_BUFFER_PTS(buffer);
+	data->encode_times[index].time = g_get_monotonic_time();
+
+	if (gst_app_src_push_buffer(GST_APP_SRC(data->appsrc), buffer) == GST_FLOW_OK)
+		gstreamer_stats_add(&data->stats, STATS_FRAMES, 1);
+	else
+		gstreamer_stats_add(&data->stats, STATS_DROPPED, 1);
+
+	if (gstreamer_stats_due(&data->stats))
+		gstreamer_stats_log(&data->stats, obs_encoder_get_name(data->encoder));
 
 	data->sample = gst_app_sink_try_pull_sample(GST_APP_SINK(data->appsink), 0);
 	if (data->sample == NULL)
@@ -361,6 +397,18 @@ bool gstreamer_encoder_encode(void *p, struct encoder_frame *frame, struct encod
 
 	packet->keyframe = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
 
+	gstreamer_stats_add(&data->stats, STATS_PACKETS, 1);
+	gstreamer_stats_add(&data->stats, STATS_BYTES, packet->size);
+
+	// encoding latency, from pushing the frame until its packet came out
+	for (guint i = 0; i < ENCODE_TIMES; i++) {
+		if (data->encode_times[i].pts == GST_BUFFER_PTS(buffer)) {
+			gstreamer_stats_latency(&data->stats,
+						(g_get_monotonic_time() - data->encode_times[i].time) * GST_USECOND);
+			break;
+		}
+	}
+
 	return true;
 }
 
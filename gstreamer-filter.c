@@ -24,6 +24,16 @@
 #include <gst/audio/audio.h>
 #include <gst/app/app.h>
 
+#include "gstreamer-profile.h"
+#include "gstreamer-stats.h"
+
+// immutable settings snapshot. gstreamer_filter_update() publishes a new one
+// and the filter callbacks pick it up on their own thread
+typedef struct {
+	gchar *pipeline;
+	gchar *profile;
+} config_t;
+
 typedef struct {
 	GstElement *pipe;
 	GstElement *appsrc;
@@ -32,14 +42,81 @@ typedef struct {
 	GstAudioInfo audio_info;
 	obs_source_t *source;
 	obs_data_t *settings;
+	config_t *config;
+	config_t *config_pending;
+	gstreamer_stats_t stats;
+	gpointer profile;
+	gint64 profile_time;
 } data_t;
 
+static config_t *config_new(obs_data_t *settings)
+{
+	config_t *config = g_new0(config_t, 1);
+
+	config->pipeline = g_strdup(obs_data_get_string(settings, "pipeline"));
+	config->profile = g_strdup(obs_data_get_string(settings, "profile"));
+
+	return config;
+}
+
+static void config_free(config_t *config)
+{
+	if (config == NULL)
+		return;
+
+	g_free(config->pipeline);
+	g_free(config->profile);
+	g_free(config);
+}
+
+static void pipeline_destroy(data_t *data)
+{
+	if (data->pipe == NULL)
+		return;
+
+	GstBus *bus = gst_element_get_bus(data->pipe);
+	gst_bus_remove_watch(bus);
+	gst_object_unref(bus);
+
+	gst_element_set_state(data->pipe, GST_STATE_NULL);
+
+	gst_object_unref(data->appsink);
+	gst_object_unref(data->appsrc);
+	gst_object_unref(data->pipe);
+
+	data->appsink = NULL;
+	data->appsrc = NULL;
+	data->pipe = NULL;
+	data->profile = NULL;
+}
+
+// take ownership of a config published by gstreamer_filter_update() and drop
+// the pipeline that was built from the previous one
+static void config_apply_pending(data_t *data)
+{
+	config_t *config;
+
+	do {
+		config = g_atomic_pointer_get(&data->config_pending);
+	} while (config != NULL && !g_atomic_pointer_compare_and_exchange(&data->config_pending, config, NULL));
+
+	if (config == NULL)
+		return;
+
+	pipeline_destroy(data);
+
+	config_free(data->config);
+	data->config = config;
+}
+
 static gboolean bus_callback(GstBus *bus, GstMessage *message, gpointer user_data)
 {
 	data_t *data = user_data;
 
 	switch (GST_MESSAGE_TYPE(message)) {
 	case GST_MESSAGE_ERROR: {
+		gstreamer_stats_add(&data->stats, STATS_ERRORS, 1);
+
 		GError *err;
 		gst_message_parse_error(message, &err, NULL);
 		const char *source_name = obs_source_get_name(data->source);
@@ -71,12 +148,51 @@ const char *gstreamer_filter_get_name_audio(void *type_data)
 	return "GStreamer Filter (Audio)";
 }
 
+static void proc_get_stats(void *user_data, calldata_t *cd)
+{
+	data_t *data = user_data;
+
+	gstreamer_stats_get(&data->stats, cd);
+}
+
+// called after every processed frame or audio packet
+static void stats_update(data_t *data, enum stats_counter counter, guint n, gint64 start)
+{
+	gstreamer_stats_add(&data->stats, counter, n);
+	gstreamer_stats_latency(&data->stats, (g_get_monotonic_time() - start) * GST_USECOND);
+
+	if (gstreamer_stats_due(&data->stats))
+		gstreamer_stats_log(&data->stats, obs_source_get_name(data->source));
+
+	if (data->profile && g_get_monotonic_time() - data->profile_time >= 30 * G_USEC_PER_SEC) {
+		gstreamer_profile_report(data->profile);
+		data->profile_time = g_get_monotonic_time();
+	}
+}
+
+// the profile is reported a last time when the pipeline goes away
+static void profile_start(data_t *data)
+{
+	if (strlen(data->config->profile) == 0)
+		return;
+
+	data->profile = gstreamer_profile_new(data->pipe, obs_source_get_name(data->source), data->config->profile);
+	g_object_set_data_full(G_OBJECT(data->pipe), "profile", data->profile, gstreamer_profile_free);
+	data->profile_time = g_get_monotonic_time();
+}
+
 void *gstreamer_filter_create(obs_data_t *settings, obs_source_t *source)
 {
 	data_t *data = g_new0(data_t, 1);
 
 	data->source = source;
 	data->settings = settings;
+	data->config = config_new(settings);
+
+	gstreamer_stats_init(&data->stats);
+
+	proc_handler_t *ph = obs_source_get_proc_handler(source);
+	proc_handler_add(ph, "void get_stats(out string stats)", proc_get_stats, data);
 
 	return data;
 }
@@ -85,17 +201,12 @@ void gstreamer_filter_destroy(void *p)
 {
 	data_t *data = (data_t *)p;
 
-	if (data->pipe != NULL) {
-		GstBus *bus = gst_element_get_bus(data->pipe);
-		gst_bus_remove_watch(bus);
-		gst_object_unref(bus);
+	pipeline_destroy(data);
 
-		gst_element_set_state(data->pipe, GST_STATE_NULL);
+	config_free(data->config);
+	config_free(data->config_pending);
 
-		gst_object_unref(data->appsrc);
-		gst_object_unref(data->appsink);
-		gst_object_unref(data->pipe);
-	}
+	gstreamer_stats_clear(&data->stats);
 
 	g_free(data);
 }
@@ -103,11 +214,13 @@ void gstreamer_filter_destroy(void *p)
 void gstreamer_filter_get_defaults_video(obs_data_t *settings)
 {
 	obs_data_set_default_string(settings, "pipeline", "videoflip video-direction=horiz");
+	obs_data_set_default_string(settings, "profile", "");
 }
 
 void gstreamer_filter_get_defaults_audio(obs_data_t *settings)
 {
 	obs_data_set_default_string(settings, "pipeline", "audioecho delay=200000000 intensity=0.3");
+	obs_data_set_default_string(settings, "profile", "");
 }
 
 void gstreamer_filter_update(void *data, obs_data_t *settings);
@@ -127,6 +240,11 @@ obs_properties_t *gstreamer_filter_get_properties(void *data)
 
 	obs_property_t *prop = obs_properties_add_text(props, "pipeline", "Pipeline", OBS_TEXT_MULTILINE);
 	obs_property_set_long_description(prop, "Use \"identity\" for passthru");
+	prop = obs_properties_add_list(props, "profile", "Profile element latency", OBS_COMBO_TYPE_LIST,
+				       OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(prop, "Off", "");
+	obs_property_list_add_string(prop, "Report to log", "log");
+	obs_property_list_add_string(prop, "Report to JSON file", "json");
 	obs_properties_add_button2(props, "apply", "Apply", on_apply_clicked, data);
 
 	return props;
@@ -135,18 +253,16 @@ obs_properties_t *gstreamer_filter_get_properties(void *data)
 void gstreamer_filter_update(void *p, obs_data_t *settings)
 {
 	data_t *data = (data_t *)p;
+	config_t *config = config_new(settings);
+	config_t *old;
 
-	if (data->pipe != NULL) {
-		gst_element_set_state(data->pipe, GST_STATE_NULL);
+	// the pipeline is owned by the filter thread, which swaps in the new
+	// config and rebuilds on its next frame
+	do {
+		old = g_atomic_pointer_get(&data->config_pending);
+	} while (!g_atomic_pointer_compare_and_exchange(&data->config_pending, old, config));
 
-		gst_object_unref(data->appsink);
-		gst_object_unref(data->appsrc);
-		gst_object_unref(data->pipe);
-
-		data->appsink = NULL;
-		data->appsrc = NULL;
-		data->pipe = NULL;
-	}
+	config_free(old);
 }
 
 struct obs_source_frame *gstreamer_filter_filter_video(void *p, struct obs_source_frame *frame)
@@ -154,6 +270,8 @@ struct obs_source_frame *gstreamer_filter_filter_video(void *p, struct obs_sourc
 	GstMapInfo info;
 	data_t *data = (data_t *)p;
 
+	config_apply_pending(data);
+
 	if (data->pipe == NULL) {
 		GError *err = NULL;
 		gchar *format = "";
@@ -207,7 +325,7 @@ struct obs_source_frame *gstreamer_filter_filter_video(void *p, struct obs_sourc
 		gchar *str = g_strdup_printf(
 			"appsrc name=appsrc format=time ! video/x-raw, width=%d, height=%d, format=%s, framerate=0/1 ! videoconvert ! "
 			"%s ! videoconvert ! video/x-raw, width=%d, height=%d, format=%s, framerate=0/1 ! appsink name=appsink sync=false",
-			frame->width, frame->height, format, obs_data_get_string(data->settings, "pipeline"),
+			frame->width, frame->height, format, data->config->pipeline,
 			frame->width, frame->height, format);
 		data->pipe = gst_parse_launch(str, &err);
 		g_free(str);
@@ -229,9 +347,13 @@ struct obs_source_frame *gstreamer_filter_filter_video(void *p, struct obs_sourc
 		gst_bus_add_watch(bus, bus_callback, data);
 		gst_object_unref(bus);
 
+		profile_start(data);
+
 		gst_element_set_state(data->pipe, GST_STATE_PLAYING);
 	}
 
+	gint64 start = g_get_monotonic_time();
+
 	GstBuffer *buffer =
 		gst_buffer_new_wrapped_full(0, frame->data[0], data->frame_size, 0, data->frame_size, NULL, NULL);
 
@@ -240,8 +362,10 @@ struct obs_source_frame *gstreamer_filter_filter_video(void *p, struct obs_sourc
 	gst_app_src_push_buffer(GST_APP_SRC(data->appsrc), buffer);
 
 	GstSample *sample = gst_app_sink_pull_sample(GST_APP_SINK(data->appsink));
-	if (sample == NULL)
+	if (sample == NULL) {
+		gstreamer_stats_add(&data->stats, STATS_DROPPED, 1);
 		return frame;
+	}
 	buffer = gst_sample_get_buffer(sample);
 
 	gst_buffer_map(buffer, &info, GST_MAP_READ);
@@ -252,6 +376,8 @@ struct obs_source_frame *gstreamer_filter_filter_video(void *p, struct obs_sourc
 	gst_buffer_unmap(buffer, &info);
 	gst_sample_unref(sample);
 
+	stats_update(data, STATS_FRAMES, 1, start);
+
 	return frame;
 }
 
@@ -260,6 +386,8 @@ struct obs_audio_data *gstreamer_filter_filter_audio(void *p, struct obs_audio_d
 	GstMapInfo info;
 	data_t *data = (data_t *)p;
 
+	config_apply_pending(data);
+
 	if (data->pipe == NULL) {
 		GError *err = NULL;
 		struct obs_audio_info audio_info;
@@ -274,8 +402,7 @@ struct obs_audio_data *gstreamer_filter_filter_audio(void *p, struct obs_audio_d
 		gchar *str = g_strdup_printf(
 			"appsrc name=appsrc format=time ! audio/x-raw, rate=%d, channels=%d, format=F32LE, layout=non-interleaved ! audioconvert ! "
 			"%s ! audioconvert ! audio/x-raw, rate=%d, channels=%d, format=F32LE, layout=non-interleaved ! appsink name=appsink sync=false",
-			data->audio_info.rate, data->audio_info.channels,
-			obs_data_get_string(data->settings, "pipeline"), data->audio_info.rate,
+			data->audio_info.rate, data->audio_info.channels, data->config->pipeline, data->audio_info.rate,
 			data->audio_info.channels);
 		data->pipe = gst_parse_launch(str, &err);
 		g_free(str);
@@ -293,9 +420,13 @@ struct obs_audio_data *gstreamer_filter_filter_audio(void *p, struct obs_audio_d
 		data->appsrc = gst_bin_get_by_name(GST_BIN(data->pipe), "appsrc");
 		data->appsink = gst_bin_get_by_name(GST_BIN(data->pipe), "appsink");
 
+		profile_start(data);
+
 		gst_element_set_state(data->pipe, GST_STATE_PLAYING);
 	}
 
+	gint64 start = g_get_monotonic_time();
+
 	gint channel_size = data->audio_info.bpf * audio_data->frames / data->audio_info.channels;
 
 	GstBuffer *buffer = gst_buffer_new_allocate(NULL, channel_size * data->audio_info.channels, NULL);
@@ -313,8 +444,10 @@ struct obs_audio_data *gstreamer_filter_filter_audio(void *p, struct obs_audio_d
 	gst_app_src_push_buffer(GST_APP_SRC(data->appsrc), buffer);
 
 	GstSample *sample = gst_app_sink_pull_sample(GST_APP_SINK(data->appsink));
-	if (sample == NULL)
+	if (sample == NULL) {
+		gstreamer_stats_add(&data->stats, STATS_DROPPED, 1);
 		return audio_data;
+	}
 
 	buffer = gst_sample_get_buffer(sample);
 
@@ -327,5 +460,7 @@ struct obs_audio_data *gstreamer_filter_filter_audio(void *p, struct obs_audio_d
 	gst_buffer_unmap(buffer, &info);
 	gst_sample_unref(sample);
 
+	stats_update(data, STATS_SAMPLES, audio_data->frames, start);
+
 	return audio_data;
 }
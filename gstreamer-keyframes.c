@@ -0,0 +1,294 @@
+/*
+ * obs-gstreamer. OBS Studio plugin.
+ * Copyright (C) 2018-2021 Florian Zwoch <fzwoch@gmail.com>
+ *
+ * This file is part of obs-gstreamer.
+ *
+ * obs-gstreamer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * obs-gstreamer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obs-gstreamer. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <obs/obs-module.h>
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+
+#include "gstreamer-keyframes.h"
+
+// video keyframe positions of a media file. the index is built once by
+// parsing (not decoding) the file in the background and cached in the
+// module's config directory, keyed by path, size and modification time.
+typedef struct {
+	gint ref;
+	gint cancelled;
+	gchar *location;
+	gchar *cache_path;
+	GArray *keyframes;
+	GArray *building;
+	bool video_probed;
+} keyframe_index_t;
+
+static void keyframe_index_unref(keyframe_index_t *index)
+{
+	if (!g_atomic_int_dec_and_test(&index->ref))
+		return;
+
+	if (index->keyframes)
+		g_array_unref(index->keyframes);
+
+	g_free(index->location);
+	g_free(index->cache_path);
+	g_free(index);
+}
+
+static GArray *keyframes_load(const char *path)
+{
+	gchar *contents;
+
+	if (!g_file_get_contents(path, &contents, NULL, NULL))
+		return NULL;
+
+	GArray *keyframes = g_array_new(FALSE, FALSE, sizeof(GstClockTime));
+
+	gchar **lines = g_strsplit(contents, "\n", -1);
+	for (gchar **line = lines; *line != NULL; line++) {
+		if (**line == '\0')
+			continue;
+
+		GstClockTime position = g_ascii_strtoull(*line, NULL, 10);
+		g_array_append_val(keyframes, position);
+	}
+	g_strfreev(lines);
+	g_free(contents);
+
+	if (keyframes->len == 0) {
+		g_array_unref(keyframes);
+		return NULL;
+	}
+
+	return keyframes;
+}
+
+static void keyframes_save(const char *path, GArray *keyframes)
+{
+	GString *str = g_string_new(NULL);
+
+	for (guint i = 0; i < keyframes->len; i++)
+		g_string_append_printf(str, "%" G_GUINT64_FORMAT "\n", g_array_index(keyframes, GstClockTime, i));
+
+	gchar *dir = g_path_get_dirname(path);
+	g_mkdir_with_parents(dir, 0755);
+	g_free(dir);
+
+	g_file_set_contents(path, str->str, str->len, NULL);
+
+	g_string_free(str, TRUE);
+}
+
+static gint keyframes_compare(gconstpointer a, gconstpointer b)
+{
+	GstClockTime pos_a = *(const GstClockTime *)a;
+	GstClockTime pos_b = *(const GstClockTime *)b;
+
+	return pos_a < pos_b ? -1 : pos_a > pos_b;
+}
+
+static GstPadProbeReturn keyframe_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+	keyframe_index_t *index = user_data;
+	GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+	if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT) || !GST_BUFFER_PTS_IS_VALID(buffer))
+		return GST_PAD_PROBE_OK;
+
+	// seek positions are stream time, the time stamps of e.g. MPEG-TS don't
+	// start at 0
+	GstEvent *event = gst_pad_get_sticky_event(pad, GST_EVENT_SEGMENT, 0);
+	if (event == NULL)
+		return GST_PAD_PROBE_OK;
+
+	const GstSegment *segment;
+	gst_event_parse_segment(event, &segment);
+
+	GstClockTime position = gst_segment_to_stream_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+	if (GST_CLOCK_TIME_IS_VALID(position))
+		g_array_append_val(index->building, position);
+
+	gst_event_unref(event);
+
+	return GST_PAD_PROBE_OK;
+}
+
+static void keyframe_pad_added(GstElement *parsebin, GstPad *pad, gpointer user_data)
+{
+	keyframe_index_t *index = user_data;
+	GstElement *pipe = GST_ELEMENT(GST_ELEMENT_PARENT(parsebin));
+
+	// every stream needs a sink, only the first video stream is indexed
+	GstElement *sink = gst_element_factory_make("fakesink", NULL);
+	g_object_set(sink, "sync", FALSE, NULL);
+	gst_bin_add(GST_BIN(pipe), sink);
+	gst_element_sync_state_with_parent(sink);
+
+	GstPad *sinkpad = gst_element_get_static_pad(sink, "sink");
+	gst_pad_link(pad, sinkpad);
+	gst_object_unref(sinkpad);
+
+	GstCaps *caps = gst_pad_get_current_caps(pad);
+	if (caps == NULL)
+		return;
+
+	const gchar *name = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+
+	if (!index->video_probed && g_str_has_prefix(name, "video/")) {
+		index->video_probed = true;
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, keyframe_probe, index, NULL);
+	}
+
+	gst_caps_unref(caps);
+}
+
+static gpointer keyframe_index_build(gpointer user_data)
+{
+	keyframe_index_t *index = user_data;
+	bool done = false;
+
+	GstElement *pipe = gst_pipeline_new(NULL);
+	GstElement *src = gst_element_factory_make("filesrc", NULL);
+	GstElement *parse = gst_element_factory_make("parsebin", NULL);
+
+	if (src == NULL || parse == NULL) {
+		blog(LOG_WARNING, "[obs-gstreamer] Cannot build keyframe index, parsebin is not available");
+
+		if (src)
+			gst_object_unref(src);
+		if (parse)
+			gst_object_unref(parse);
+		gst_object_unref(pipe);
+		keyframe_index_unref(index);
+
+		return NULL;
+	}
+
+	index->building = g_array_new(FALSE, FALSE, sizeof(GstClockTime));
+
+	g_object_set(src, "location", index->location, NULL);
+	gst_bin_add_many(GST_BIN(pipe), src, parse, NULL);
+	gst_element_link(src, parse);
+	g_signal_connect(parse, "pad-added", G_CALLBACK(keyframe_pad_added), index);
+
+	gst_element_set_state(pipe, GST_STATE_PLAYING);
+
+	GstBus *bus = gst_element_get_bus(pipe);
+	while (!g_atomic_int_get(&index->cancelled)) {
+		GstMessage *msg =
+			gst_bus_timed_pop_filtered(bus, 100 * GST_MSECOND, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+		if (msg == NULL)
+			continue;
+
+		done = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+		gst_message_unref(msg);
+		break;
+	}
+	gst_object_unref(bus);
+
+	gst_element_set_state(pipe, GST_STATE_NULL);
+	gst_object_unref(pipe);
+
+	GArray *keyframes = index->building;
+	index->building = NULL;
+
+	if (done && keyframes->len > 0) {
+		g_array_sort(keyframes, keyframes_compare);
+		keyframes_save(index->cache_path, keyframes);
+
+		blog(LOG_INFO, "[obs-gstreamer] Built keyframe index with %u keyframes for %s", keyframes->len,
+		     index->location);
+
+		g_atomic_pointer_set(&index->keyframes, keyframes);
+	} else {
+		g_array_unref(keyframes);
+	}
+
+	keyframe_index_unref(index);
+
+	return NULL;
+}
+
+gpointer gstreamer_keyframe_index_new(const char *location)
+{
+	GStatBuf st;
+
+	if (g_stat(location, &st) != 0)
+		return NULL;
+
+	keyframe_index_t *index = g_new0(keyframe_index_t, 1);
+	index->ref = 1;
+	index->location = g_strdup(location);
+
+	// the version keeps indexes of raw time stamps from being loaded
+	gchar *key = g_strdup_printf("2:%s:%" G_GINT64_FORMAT ":%" G_GINT64_FORMAT, location, (gint64)st.st_size,
+				     (gint64)st.st_mtime);
+	gchar *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+	gchar *name = g_strdup_printf("keyframes/%s.idx", hash);
+
+	char *path = obs_module_config_path(name);
+	index->cache_path = g_strdup(path);
+	bfree(path);
+
+	g_free(name);
+	g_free(hash);
+	g_free(key);
+
+	index->keyframes = keyframes_load(index->cache_path);
+
+	if (index->keyframes == NULL) {
+		g_atomic_int_inc(&index->ref);
+		g_thread_unref(g_thread_new("GStreamer Keyframes", keyframe_index_build, index));
+	}
+
+	return index;
+}
+
+void gstreamer_keyframe_index_release(gpointer p)
+{
+	keyframe_index_t *index = p;
+
+	// an unfinished index is dropped, the next pipeline for the file starts over
+	g_atomic_int_set(&index->cancelled, 1);
+
+	keyframe_index_unref(index);
+}
+
+// the last keyframe at or before position, -1 while the index is not ready
+gint64 gstreamer_keyframe_index_find(gpointer p, gint64 position)
+{
+	keyframe_index_t *index = p;
+	GArray *keyframes = g_atomic_pointer_get(&index->keyframes);
+
+	if (keyframes == NULL)
+		return -1;
+
+	guint low = 0;
+	guint high = keyframes->len;
+
+	while (high - low > 1) {
+		guint mid = (low + high) / 2;
+
+		if (g_array_index(keyframes, GstClockTime, mid) <= (GstClockTime)position)
+			low = mid;
+		else
+			high = mid;
+	}
+
+	return g_array_index(keyframes, GstClockTime, low);
+}
@@ -22,12 +22,15 @@
 #include <gst/gst.h>
 #include <gst/app/app.h>
 
+#include "gstreamer-stats.h"
+
 typedef struct {
 	GstElement *pipe;
 	GstElement *video;
 	GstElement *audio;
 	obs_output_t *output;
 	obs_data_t *settings;
+	gstreamer_stats_t stats;
 } data_t;
 
 const char *gstreamer_output_get_name(void *type_data)
@@ -35,6 +38,13 @@ const char *gstreamer_output_get_name(void *type_data)
 	return "GStreamer Output";
 }
 
+static void proc_get_stats(void *user_data, calldata_t *cd)
+{
+	data_t *data = user_data;
+
+	gstreamer_stats_get(&data->stats, cd);
+}
+
 void *gstreamer_output_create(obs_data_t *settings, obs_output_t *output)
 {
 	data_t *data = g_new0(data_t, 1);
@@ -42,11 +52,20 @@ void *gstreamer_output_create(obs_data_t *settings, obs_output_t *output)
 	data->output = output;
 	data->settings = settings;
 
+	gstreamer_stats_init(&data->stats);
+
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+	proc_handler_add(ph, "void get_stats(out string stats)", proc_get_stats, data);
+
 	return data;
 }
 
-void gstreamer_output_destroy(void *data)
+void gstreamer_output_destroy(void *p)
 {
+	data_t *data = (data_t *)p;
+
+	gstreamer_stats_clear(&data->stats);
+
 	g_free(data);
 }
 
@@ -134,7 +153,20 @@ void gstreamer_output_encoded_packet(void *p, struct encoder_packet *packet)
 
 	GstElement *appsrc = packet->type == OBS_ENCODER_VIDEO ? data->video : data->audio;
 
-	gst_app_src_push_buffer(GST_APP_SRC(appsrc), buffer);
+	if (gst_app_src_push_buffer(GST_APP_SRC(appsrc), buffer) == GST_FLOW_OK) {
+		gstreamer_stats_add(&data->stats, STATS_PACKETS, 1);
+		gstreamer_stats_add(&data->stats, STATS_BYTES, packet->size);
+	} else {
+		gstreamer_stats_add(&data->stats, STATS_DROPPED, 1);
+	}
+
+	// bytes waiting in the appsrcs for the pipeline to take them
+	g_atomic_int_set(&data->stats.queue_depth,
+			 gst_app_src_get_current_level_bytes(GST_APP_SRC(data->video)) +
+				 gst_app_src_get_current_level_bytes(GST_APP_SRC(data->audio)));
+
+	if (gstreamer_stats_due(&data->stats))
+		gstreamer_stats_log(&data->stats, obs_output_get_name(data->output));
 }
 
 void gstreamer_output_get_defaults(obs_data_t *settings)
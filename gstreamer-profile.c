@@ -0,0 +1,344 @@
+/*
+ * obs-gstreamer. OBS Studio plugin.
+ * Copyright (C) 2018-2021 Florian Zwoch <fzwoch@gmail.com>
+ *
+ * This file is part of obs-gstreamer.
+ *
+ * obs-gstreamer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * obs-gstreamer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obs-gstreamer. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <obs/obs-module.h>
+#include <gst/gst.h>
+
+#include "gstreamer-profile.h"
+
+// per-element latency of a pipeline, measured with buffer probes on every
+// pad. elements handing buffers to another thread (queues) report how long
+// buffers waited in them, all others how long they took from a buffer coming
+// in until one went out on the same thread. nothing is installed unless
+// profiling is enabled for the source or filter.
+typedef struct {
+	gchar *name;
+	gchar *factory;
+	bool queue;
+	GMutex mutex;
+	GThread *thread;
+	gint64 in_time;
+	GHashTable *fifos;
+	guint64 count;
+	gint64 total;
+	gint64 max;
+} profile_element_t;
+
+typedef struct {
+	gchar *name;
+	bool json;
+	GMutex mutex;
+	GHashTable *elements;
+} profile_t;
+
+static void profile_fifo_free(gpointer user_data)
+{
+	GQueue *fifo = user_data;
+
+	g_queue_free_full(fifo, g_free);
+}
+
+static void profile_element_free(gpointer user_data)
+{
+	profile_element_t *element = user_data;
+
+	g_hash_table_destroy(element->fifos);
+	g_mutex_clear(&element->mutex);
+	g_free(element->name);
+	g_free(element->factory);
+	g_free(element);
+}
+
+// arrival times of a queue are kept per stream, matching multiqueue's
+// sink_%u and src_%u pads
+static GQueue *profile_fifo(profile_element_t *element, GstPad *pad)
+{
+	const gchar *suffix = strrchr(GST_PAD_NAME(pad), '_');
+	gint id = suffix ? atoi(suffix + 1) : 0;
+
+	GQueue *fifo = g_hash_table_lookup(element->fifos, GINT_TO_POINTER(id));
+	if (fifo == NULL) {
+		fifo = g_queue_new();
+		g_hash_table_insert(element->fifos, GINT_TO_POINTER(id), fifo);
+	}
+
+	return fifo;
+}
+
+static GstPadProbeReturn profile_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+	profile_element_t *element = user_data;
+	gint64 now = g_get_monotonic_time();
+
+	g_mutex_lock(&element->mutex);
+
+	if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_FLUSH) {
+		// flushed buffers never come out
+		if (element->queue && GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_FLUSH_STOP) {
+			GQueue *fifo = profile_fifo(element, pad);
+			while (!g_queue_is_empty(fifo))
+				g_free(g_queue_pop_head(fifo));
+		}
+	} else if (GST_PAD_IS_SINK(pad)) {
+		if (element->queue) {
+			GQueue *fifo = profile_fifo(element, pad);
+
+			// leaky queues drop buffers, don't let that pile up
+			if (g_queue_get_length(fifo) > 10000)
+				g_free(g_queue_pop_head(fifo));
+
+			gint64 *in_time = g_new(gint64, 1);
+			*in_time = now;
+			g_queue_push_tail(fifo, in_time);
+		} else {
+			element->thread = g_thread_self();
+			element->in_time = now;
+		}
+	} else {
+		gint64 in_time = -1;
+
+		if (element->queue) {
+			gint64 *queued = g_queue_pop_head(profile_fifo(element, pad));
+			if (queued) {
+				in_time = *queued;
+				g_free(queued);
+			}
+		} else if (element->thread == g_thread_self()) {
+			in_time = element->in_time;
+		}
+
+		if (in_time >= 0) {
+			element->count++;
+			element->total += now - in_time;
+			element->max = MAX(element->max, now - in_time);
+		}
+	}
+
+	g_mutex_unlock(&element->mutex);
+
+	return GST_PAD_PROBE_OK;
+}
+
+static void profile_add_pad(profile_element_t *element, GstPad *pad)
+{
+	GstPadProbeType type = GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST;
+
+	if (GST_PAD_IS_SINK(pad))
+		type |= GST_PAD_PROBE_TYPE_EVENT_FLUSH;
+
+	gst_pad_add_probe(pad, type, profile_probe, element, NULL);
+}
+
+static void profile_pad_added(GstElement *object, GstPad *pad, gpointer user_data)
+{
+	profile_add_pad(user_data, pad);
+}
+
+static gboolean profile_foreach_pad(GstElement *object, GstPad *pad, gpointer user_data)
+{
+	profile_add_pad(user_data, pad);
+
+	return TRUE;
+}
+
+static void profile_add_element(profile_t *profile, GstElement *object)
+{
+	// bins only forward to their children through ghost pads
+	if (GST_IS_BIN(object))
+		return;
+
+	g_mutex_lock(&profile->mutex);
+
+	if (g_hash_table_contains(profile->elements, object)) {
+		g_mutex_unlock(&profile->mutex);
+		return;
+	}
+
+	GstElementFactory *factory = gst_element_get_factory(object);
+
+	profile_element_t *element = g_new0(profile_element_t, 1);
+	element->name = gst_element_get_name(object);
+	element->factory = g_strdup(factory ? GST_OBJECT_NAME(factory) : "");
+	element->queue = g_strcmp0(element->factory, "queue") == 0 || g_strcmp0(element->factory, "queue2") == 0 ||
+			 g_strcmp0(element->factory, "multiqueue") == 0;
+	element->fifos = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, profile_fifo_free);
+	g_mutex_init(&element->mutex);
+
+	g_hash_table_insert(profile->elements, object, element);
+
+	g_mutex_unlock(&profile->mutex);
+
+	g_signal_connect(object, "pad-added", G_CALLBACK(profile_pad_added), element);
+	gst_element_foreach_pad(object, profile_foreach_pad, element);
+}
+
+// elements created at runtime, e.g. by decodebin
+static void profile_deep_element_added(GstBin *bin, GstBin *sub_bin, GstElement *object, gpointer user_data)
+{
+	profile_add_element(user_data, object);
+}
+
+gpointer gstreamer_profile_new(GstElement *pipe, const char *name, const char *mode)
+{
+	profile_t *profile = g_new0(profile_t, 1);
+
+	profile->name = g_strdup(name);
+	profile->json = g_strcmp0(mode, "json") == 0;
+	profile->elements = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, profile_element_free);
+	g_mutex_init(&profile->mutex);
+
+	g_signal_connect(pipe, "deep-element-added", G_CALLBACK(profile_deep_element_added), profile);
+
+	GstIterator *it = gst_bin_iterate_recurse(GST_BIN(pipe));
+	GValue item = G_VALUE_INIT;
+
+	while (gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+		profile_add_element(profile, g_value_get_object(&item));
+		g_value_reset(&item);
+	}
+
+	g_value_unset(&item);
+	gst_iterator_free(it);
+
+	return profile;
+}
+
+typedef struct {
+	const profile_element_t *element;
+	guint64 count;
+	gint64 total;
+	gint64 max;
+} profile_entry_t;
+
+static gint profile_entry_compare(gconstpointer a, gconstpointer b)
+{
+	const profile_entry_t *entry_a = a;
+	const profile_entry_t *entry_b = b;
+
+	gint64 avg_a = entry_a->total / entry_a->count;
+	gint64 avg_b = entry_b->total / entry_b->count;
+
+	return avg_a < avg_b ? 1 : avg_a > avg_b ? -1 : 0;
+}
+
+static void profile_save_json(profile_t *profile, GArray *entries)
+{
+	obs_data_t *obj = obs_data_create();
+	obs_data_array_t *array = obs_data_array_create();
+
+	for (guint i = 0; i < entries->len; i++) {
+		profile_entry_t *entry = &g_array_index(entries, profile_entry_t, i);
+		obs_data_t *item = obs_data_create();
+
+		obs_data_set_string(item, "name", entry->element->name);
+		obs_data_set_string(item, "factory", entry->element->factory);
+		obs_data_set_string(item, "type", entry->element->queue ? "queue" : "processing");
+		obs_data_set_int(item, "buffers", entry->count);
+		obs_data_set_double(item, "avg_ms", entry->total / (double)entry->count / 1000.0);
+		obs_data_set_double(item, "max_ms", entry->max / 1000.0);
+		obs_data_set_double(item, "total_ms", entry->total / 1000.0);
+
+		obs_data_array_push_back(array, item);
+		obs_data_release(item);
+	}
+
+	obs_data_set_string(obj, "source", profile->name);
+	obs_data_set_array(obj, "elements", array);
+	obs_data_array_release(array);
+
+	gchar *file = g_strdup_printf("profile/%s.json", profile->name);
+	g_strcanon(file + strlen("profile/"), G_CSET_a_2_z G_CSET_A_2_Z G_CSET_DIGITS "-_.", '_');
+
+	char *path = obs_module_config_path(file);
+
+	gchar *dir = g_path_get_dirname(path);
+	g_mkdir_with_parents(dir, 0755);
+	g_free(dir);
+
+	if (obs_data_save_json(obj, path))
+		blog(LOG_INFO, "[obs-gstreamer] %s: wrote profile to %s", profile->name, path);
+
+	bfree(path);
+	g_free(file);
+
+	obs_data_release(obj);
+}
+
+// report sorted by average latency, slowest element first
+void gstreamer_profile_report(gpointer p)
+{
+	profile_t *profile = p;
+	GArray *entries = g_array_new(FALSE, FALSE, sizeof(profile_entry_t));
+	GHashTableIter iter;
+	gpointer value;
+
+	g_mutex_lock(&profile->mutex);
+
+	g_hash_table_iter_init(&iter, profile->elements);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		profile_element_t *element = value;
+		profile_entry_t entry = {element};
+
+		g_mutex_lock(&element->mutex);
+		entry.count = element->count;
+		entry.total = element->total;
+		entry.max = element->max;
+		g_mutex_unlock(&element->mutex);
+
+		if (entry.count > 0)
+			g_array_append_val(entries, entry);
+	}
+
+	g_array_sort(entries, profile_entry_compare);
+
+	if (profile->json) {
+		profile_save_json(profile, entries);
+	} else {
+		blog(LOG_INFO, "[obs-gstreamer] %s: profile of %u elements", profile->name, entries->len);
+
+		for (guint i = 0; i < entries->len; i++) {
+			profile_entry_t *entry = &g_array_index(entries, profile_entry_t, i);
+
+			blog(LOG_INFO,
+			     "[obs-gstreamer] %s:   %s (%s): %s %.2f ms avg, %.2f ms max, %" G_GUINT64_FORMAT
+			     " buffers",
+			     profile->name, entry->element->name, entry->element->factory,
+			     entry->element->queue ? "queued" : "processing", entry->total / (double)entry->count / 1000.0,
+			     entry->max / 1000.0, entry->count);
+		}
+	}
+
+	g_mutex_unlock(&profile->mutex);
+
+	g_array_free(entries, TRUE);
+}
+
+// reports one last time, the pipeline must not be streaming anymore
+void gstreamer_profile_free(gpointer p)
+{
+	profile_t *profile = p;
+
+	gstreamer_profile_report(profile);
+
+	g_hash_table_destroy(profile->elements);
+	g_mutex_clear(&profile->mutex);
+	g_free(profile->name);
+	g_free(profile);
+}
@@ -0,0 +1,31 @@
+/*
+ * obs-gstreamer. OBS Studio plugin.
+ * Copyright (C) 2018-2021 Florian Zwoch <fzwoch@gmail.com>
+ *
+ * This file is part of obs-gstreamer.
+ *
+ * obs-gstreamer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * obs-gstreamer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obs-gstreamer. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GSTREAMER_PROFILE_H
+#define GSTREAMER_PROFILE_H
+
+#include <gst/gst.h>
+
+// per-element latency of a pipeline
+gpointer gstreamer_profile_new(GstElement *pipe, const char *name, const char *mode);
+void gstreamer_profile_report(gpointer profile);
+void gstreamer_profile_free(gpointer profile);
+
+#endif
@@ -0,0 +1,322 @@
+/*
+ * obs-gstreamer. OBS Studio plugin.
+ * Copyright (C) 2018-2021 Florian Zwoch <fzwoch@gmail.com>
+ *
+ * This file is part of obs-gstreamer.
+ *
+ * obs-gstreamer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * obs-gstreamer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obs-gstreamer. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <obs/obs-module.h>
+#include <gst/gst.h>
+#include <gst/app/app.h>
+
+#include "gstreamer-shared.h"
+
+// sources in shared mode with the same pipeline run it only once. the decoded
+// samples are handed to an appsrc in each source's own pipeline, which does
+// the conversion and keeps its own state.
+typedef struct {
+	gchar *key;
+	GstElement *pipe;
+	guint ref;
+
+	GMutex mutex;
+	GPtrArray *consumers;
+} shared_t;
+
+typedef struct {
+	shared_t *shared;
+	GstElement *video;
+	GstElement *audio;
+} consumer_t;
+
+static GMutex shared_mutex;
+static GHashTable *shared_pipelines;
+
+// pipelines only differing in white space are the same
+static gchar *shared_key(const char *pipeline)
+{
+	gchar **tokens = g_strsplit_set(pipeline, " \t\r\n", -1);
+	GString *key = g_string_new(NULL);
+
+	for (gchar **token = tokens; *token; token++) {
+		if (**token == '\0')
+			continue;
+		if (key->len > 0)
+			g_string_append_c(key, ' ');
+		g_string_append(key, *token);
+	}
+
+	g_strfreev(tokens);
+
+	return g_string_free(key, FALSE);
+}
+
+// the time stamps are moved from the running time of the shared pipeline to
+// the one of the consumer, the memory itself is not copied
+static void consumer_push(GstElement *appsrc, GstSample *sample, GstClockTime base_time)
+{
+	// a consumer that falls behind drops instead of queuing up decoded frames
+	if (gst_app_src_get_current_level_bytes(GST_APP_SRC(appsrc)) > gst_app_src_get_max_bytes(GST_APP_SRC(appsrc)))
+		return;
+
+	GstClock *clock = gst_element_get_clock(appsrc);
+	if (clock == NULL)
+		return;
+
+	GstBuffer *buffer = gst_sample_get_buffer(sample);
+	GstClockTime running_time =
+		gst_segment_to_running_time(gst_sample_get_segment(sample), GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+	GstClockTime consumer_base_time = gst_element_get_base_time(appsrc);
+
+	// without a time stamp the sample is due when it arrives
+	if (!GST_CLOCK_TIME_IS_VALID(running_time))
+		running_time = gst_clock_get_time(clock) - base_time;
+
+	gst_object_unref(clock);
+
+	if (running_time + base_time < consumer_base_time)
+		return;
+
+	buffer = gst_buffer_copy(buffer);
+	GST_BUFFER_PTS(buffer) = running_time + base_time - consumer_base_time;
+	GST_BUFFER_DTS(buffer) = GST_CLOCK_TIME_NONE;
+
+	GstSample *copy = gst_sample_new(buffer, gst_sample_get_caps(sample), NULL, NULL);
+	gst_app_src_push_sample(GST_APP_SRC(appsrc), copy);
+	gst_sample_unref(copy);
+	gst_buffer_unref(buffer);
+}
+
+static void shared_push(shared_t *shared, GstAppSink *appsink, bool video)
+{
+	GstSample *sample = gst_app_sink_pull_sample(appsink);
+	if (sample == NULL)
+		return;
+
+	GstClockTime base_time = gst_element_get_base_time(shared->pipe);
+
+	g_mutex_lock(&shared->mutex);
+
+	for (guint i = 0; i < shared->consumers->len; i++) {
+		consumer_t *consumer = g_ptr_array_index(shared->consumers, i);
+		GstElement *appsrc = video ? consumer->video : consumer->audio;
+
+		if (appsrc)
+			consumer_push(appsrc, sample, base_time);
+	}
+
+	g_mutex_unlock(&shared->mutex);
+
+	gst_sample_unref(sample);
+}
+
+static GstFlowReturn shared_video_sample(GstAppSink *appsink, gpointer user_data)
+{
+	shared_push(user_data, appsink, true);
+
+	return GST_FLOW_OK;
+}
+
+static GstFlowReturn shared_audio_sample(GstAppSink *appsink, gpointer user_data)
+{
+	shared_push(user_data, appsink, false);
+
+	return GST_FLOW_OK;
+}
+
+// a pipeline that failed or ended is not handed to new consumers. the current
+// ones see end-of-stream and restart according to their own settings.
+static void shared_retire(shared_t *shared)
+{
+	g_mutex_lock(&shared_mutex);
+	if (g_hash_table_lookup(shared_pipelines, shared->key) == shared)
+		g_hash_table_remove(shared_pipelines, shared->key);
+	g_mutex_unlock(&shared_mutex);
+
+	g_mutex_lock(&shared->mutex);
+
+	for (guint i = 0; i < shared->consumers->len; i++) {
+		consumer_t *consumer = g_ptr_array_index(shared->consumers, i);
+
+		if (consumer->video)
+			gst_app_src_end_of_stream(GST_APP_SRC(consumer->video));
+		if (consumer->audio)
+			gst_app_src_end_of_stream(GST_APP_SRC(consumer->audio));
+	}
+
+	g_mutex_unlock(&shared->mutex);
+}
+
+// runs on the streaming threads, there is no main loop for shared pipelines
+static GstBusSyncReply shared_bus(GstBus *bus, GstMessage *message, gpointer user_data)
+{
+	shared_t *shared = user_data;
+	GError *err = NULL;
+	gchar *debug = NULL;
+
+	switch (GST_MESSAGE_TYPE(message)) {
+	case GST_MESSAGE_ERROR:
+		gst_message_parse_error(message, &err, &debug);
+		blog(LOG_ERROR, "[obs-gstreamer] shared pipeline: %s", err->message);
+		if (debug)
+			blog(LOG_DEBUG, "%s", debug);
+		g_error_free(err);
+		g_free(debug);
+		shared_retire(shared);
+		break;
+	case GST_MESSAGE_EOS:
+		shared_retire(shared);
+		break;
+	default:
+		break;
+	}
+
+	return GST_BUS_DROP;
+}
+
+static void shared_sink_setup(shared_t *shared, const char *name, GstFlowReturn (*new_sample)(GstAppSink *, gpointer))
+{
+	GstElement *appsink = gst_bin_get_by_name(GST_BIN(shared->pipe), name);
+	GstPad *pad = gst_element_get_static_pad(appsink, "sink");
+
+	// an unlinked sink would keep the pipeline from prerolling
+	if (!gst_pad_is_linked(pad)) {
+		gst_bin_remove(GST_BIN(shared->pipe), appsink);
+	} else {
+		GstAppSinkCallbacks cbs = {NULL, NULL, new_sample};
+		gst_app_sink_set_callbacks(GST_APP_SINK(appsink), &cbs, shared, NULL);
+	}
+
+	gst_object_unref(pad);
+	gst_object_unref(appsink);
+}
+
+static shared_t *shared_new(const char *key, const char *pipeline, const char *name)
+{
+	GError *err = NULL;
+
+	gchar *description = g_strdup_printf("appsink name=video appsink name=audio %s", pipeline);
+	GstElement *pipe = gst_parse_launch(description, &err);
+	g_free(description);
+	if (err != NULL) {
+		blog(LOG_ERROR, "[obs-gstreamer] %s: Cannot start shared pipeline: %s", name, err->message);
+		g_error_free(err);
+
+		if (pipe)
+			gst_object_unref(pipe);
+
+		return NULL;
+	}
+
+	shared_t *shared = g_new0(shared_t, 1);
+	shared->key = g_strdup(key);
+	shared->pipe = pipe;
+	shared->consumers = g_ptr_array_new();
+	g_mutex_init(&shared->mutex);
+
+	shared_sink_setup(shared, "video", shared_video_sample);
+	shared_sink_setup(shared, "audio", shared_audio_sample);
+
+	GstBus *bus = gst_element_get_bus(pipe);
+	gst_bus_set_sync_handler(bus, shared_bus, shared, NULL);
+	gst_object_unref(bus);
+
+	return shared;
+}
+
+// video and audio are the appsrcs of the consumer's pipeline
+gpointer gstreamer_shared_attach(const char *pipeline, GstElement *video, GstElement *audio, const char *name)
+{
+	gchar *key = shared_key(pipeline);
+
+	g_mutex_lock(&shared_mutex);
+
+	if (shared_pipelines == NULL)
+		shared_pipelines = g_hash_table_new(g_str_hash, g_str_equal);
+
+	shared_t *shared = g_hash_table_lookup(shared_pipelines, key);
+	bool created = shared == NULL;
+	if (created) {
+		shared = shared_new(key, pipeline, name);
+		if (shared == NULL) {
+			g_mutex_unlock(&shared_mutex);
+			g_free(key);
+			return NULL;
+		}
+
+		g_hash_table_insert(shared_pipelines, shared->key, shared);
+	}
+
+	shared->ref++;
+
+	g_mutex_unlock(&shared_mutex);
+
+	g_free(key);
+
+	consumer_t *consumer = g_new0(consumer_t, 1);
+	consumer->shared = shared;
+	consumer->video = video ? gst_object_ref(video) : NULL;
+	consumer->audio = audio ? gst_object_ref(audio) : NULL;
+
+	g_mutex_lock(&shared->mutex);
+	g_ptr_array_add(shared->consumers, consumer);
+	g_mutex_unlock(&shared->mutex);
+
+	// not while holding shared_mutex, elements failing to start post their
+	// errors on this thread and shared_bus() takes it
+	if (created) {
+		gst_element_set_state(shared->pipe, GST_STATE_PLAYING);
+		blog(LOG_INFO, "[obs-gstreamer] %s: Started shared pipeline", name);
+	}
+
+	return consumer;
+}
+
+void gstreamer_shared_detach(gpointer user_data)
+{
+	consumer_t *consumer = user_data;
+	shared_t *shared = consumer->shared;
+
+	g_mutex_lock(&shared->mutex);
+	g_ptr_array_remove(shared->consumers, consumer);
+	g_mutex_unlock(&shared->mutex);
+
+	if (consumer->video)
+		gst_object_unref(consumer->video);
+	if (consumer->audio)
+		gst_object_unref(consumer->audio);
+	g_free(consumer);
+
+	g_mutex_lock(&shared_mutex);
+
+	bool last = --shared->ref == 0;
+	if (last && g_hash_table_lookup(shared_pipelines, shared->key) == shared)
+		g_hash_table_remove(shared_pipelines, shared->key);
+
+	g_mutex_unlock(&shared_mutex);
+
+	if (!last)
+		return;
+
+	// also waits for the streaming threads still working with the consumers
+	gst_element_set_state(shared->pipe, GST_STATE_NULL);
+	gst_object_unref(shared->pipe);
+
+	g_ptr_array_free(shared->consumers, TRUE);
+	g_mutex_clear(&shared->mutex);
+	g_free(shared->key);
+	g_free(shared);
+}
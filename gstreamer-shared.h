@@ -0,0 +1,30 @@
+/*
+ * obs-gstreamer. OBS Studio plugin.
+ * Copyright (C) 2018-2021 Florian Zwoch <fzwoch@gmail.com>
+ *
+ * This file is part of obs-gstreamer.
+ *
+ * obs-gstreamer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * obs-gstreamer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obs-gstreamer. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GSTREAMER_SHARED_H
+#define GSTREAMER_SHARED_H
+
+#include <gst/gst.h>
+
+// one pipeline feeding the appsrcs of all sources sharing it
+gpointer gstreamer_shared_attach(const char *pipeline, GstElement *video, GstElement *audio, const char *name);
+void gstreamer_shared_detach(gpointer consumer);
+
+#endif
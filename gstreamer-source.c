@@ -23,26 +23,204 @@
 #include <gst/video/video.h>
 #include <gst/audio/audio.h>
 #include <gst/app/app.h>
-#include <gst/net/gstnet.h>
+
+#include "gstreamer-clock.h"
+#include "gstreamer-keyframes.h"
+#include "gstreamer-profile.h"
+#include "gstreamer-shared.h"
+#include "gstreamer-stats.h"
+
+// immutable snapshot of the settings needed outside of the OBS threads,
+// rebuilt with every pipeline so streaming threads never query obs_data_t
+typedef struct {
+	bool use_timestamps_video;
+	bool use_timestamps_audio;
+	bool clear_on_end;
+	bool restart_on_eos;
+	bool restart_on_error;
+	gint restart_timeout;
+	bool loop;
+	bool qos;
+	bool obs_clock;
+	bool skip_unchanged;
+	gint keepalive_interval;
+} config_t;
+
+// event loop shared by several sources. it runs the bus watches, restart
+// timeouts and media control invokes of all sources assigned to it, so all
+// work for one source stays serialized in the order it was queued.
+typedef struct {
+	GThread *thread;
+	GMainContext *context;
+	GMainLoop *loop;
+	guint sources;
+} worker_t;
+
+static GMutex workers_mutex;
+static worker_t *workers;
+static guint workers_count;
+static guint workers_ref;
+
+static gpointer worker_run(gpointer user_data)
+{
+	worker_t *worker = user_data;
+
+	g_main_context_push_thread_default(worker->context);
+
+	g_main_loop_run(worker->loop);
+
+	g_main_context_pop_thread_default(worker->context);
+
+	return NULL;
+}
+
+// assign a source to the least busy worker, the pool is started with the
+// first source and defaults to one worker per core
+static worker_t *worker_acquire(void)
+{
+	g_mutex_lock(&workers_mutex);
+
+	if (workers_ref++ == 0) {
+		workers_count = g_get_num_processors();
+
+		const gchar *env = g_getenv("OBS_GSTREAMER_WORKERS");
+		if (env != NULL && g_ascii_strtoull(env, NULL, 10) > 0)
+			workers_count = g_ascii_strtoull(env, NULL, 10);
+
+		workers = g_new0(worker_t, workers_count);
+
+		for (guint i = 0; i < workers_count; i++) {
+			workers[i].context = g_main_context_new();
+			workers[i].loop = g_main_loop_new(workers[i].context, FALSE);
+			workers[i].thread = g_thread_new("GStreamer Worker", worker_run, &workers[i]);
+		}
+
+		blog(LOG_INFO, "[obs-gstreamer] started %u source workers", workers_count);
+	}
+
+	worker_t *worker = &workers[0];
+	for (guint i = 1; i < workers_count; i++) {
+		if (workers[i].sources < worker->sources)
+			worker = &workers[i];
+	}
+	worker->sources++;
+
+	g_mutex_unlock(&workers_mutex);
+
+	return worker;
+}
+
+static void worker_release(worker_t *worker)
+{
+	g_mutex_lock(&workers_mutex);
+
+	worker->sources--;
+
+	if (--workers_ref == 0) {
+		for (guint i = 0; i < workers_count; i++) {
+			g_main_loop_quit(workers[i].loop);
+			g_thread_join(workers[i].thread);
+			g_main_loop_unref(workers[i].loop);
+			g_main_context_unref(workers[i].context);
+		}
+
+		g_free(workers);
+		workers = NULL;
+		workers_count = 0;
+	}
+
+	g_mutex_unlock(&workers_mutex);
+}
+
+enum first_frame_reason {
+	FIRST_FRAME_START,
+	FIRST_FRAME_RESUME,
+	FIRST_FRAME_SEEK,
+};
+
+#define LATENCY_HISTORY 32
+
+typedef struct {
+	gint64 time; // ms since epoch
+	gint latency; // ms
+	guint problems;
+} latency_step_t;
 
 typedef struct {
 	GstElement *pipe;
-	GstClock *clock;
+	GstElement *pipe_pending;
+	gint pipe_pending_generation;
+	gint64 pipe_pending_start;
+	GSource *swap_timeout;
 	obs_source_t *source;
 	obs_data_t *settings;
-	gint64 frame_count;
-	gint64 audio_count;
-	enum obs_media_state obs_media_state;
-	gint64 seek_pos_pending;
-	bool buffering;
+	const config_t *config;
+	gint generation;
+	gint active_generation;
+	gint pending_generation;
+	// read by the OBS media callbacks without locking, written on the worker
+	// and the streaming threads
+	gint obs_media_state;
+	gint buffering;
+	gint position_ms;
+	gint duration_ms;
+	// not on program, read by the streaming threads
+	gint inactive;
+	gint seek_pending_ms;
+	gint seek_scheduled;
+	bool seek_in_flight;
+	bool seek_trick;
+	gint64 seek_time;
+	gint64 seek_last_pos;
+	GSource *seek_settle;
+	bool standby;
+	bool standby_paused;
+	gulong standby_probe_video;
+	gulong standby_probe_audio;
+	gint first_frame_pending;
+	gint64 first_frame_start;
+	enum first_frame_reason first_frame_reason;
+	gint64 cold_start_time;
 	GSource *timeout;
-	GThread *thread;
-	GMainLoop *loop;
+	GSource *stats_timeout;
+	guint64 stats_decimated;
+	gstreamer_stats_t stats;
+	gint64 profile_time;
+	gint late_samples;
+	gint latency_ms;
+	GMutex latency_mutex;
+	latency_step_t latency_history[LATENCY_HISTORY];
+	guint latency_history_count;
+	worker_t *worker;
+	bool invoke_done;
 	GMutex mutex;
 	GCond cond;
 } data_t;
 
-static void create_pipeline(data_t *data);
+static GstElement *create_pipeline(data_t *data);
+static gboolean pipeline_seek_to_pending(gpointer user_data);
+
+static config_t *config_new(obs_data_t *settings)
+{
+	config_t *config = g_new0(config_t, 1);
+
+	config->use_timestamps_video = obs_data_get_bool(settings, "use_timestamps_video");
+	config->use_timestamps_audio = obs_data_get_bool(settings, "use_timestamps_audio");
+	config->clear_on_end = obs_data_get_bool(settings, "clear_on_end");
+	config->restart_on_eos = obs_data_get_bool(settings, "restart_on_eos");
+	config->restart_on_error = obs_data_get_bool(settings, "restart_on_error");
+	config->restart_timeout = obs_data_get_int(settings, "restart_timeout");
+	config->loop = obs_data_get_bool(settings, "loop");
+	config->qos = obs_data_get_bool(settings, "qos");
+	config->skip_unchanged = obs_data_get_bool(settings, "skip_unchanged");
+	config->keepalive_interval = obs_data_get_int(settings, "keepalive_interval");
+	// a NTP server takes precedence, shared pipelines run on the system clock
+	config->obs_clock = strcmp(obs_data_get_string(settings, "clock"), "obs") == 0 &&
+			    strlen(obs_data_get_string(settings, "ntp_server")) == 0 &&
+			    !obs_data_get_bool(settings, "shared");
+
+	return config;
+}
 
 static void timeout_destroy(gpointer user_data)
 {
@@ -53,47 +231,312 @@ static void timeout_destroy(gpointer user_data)
 	data->timeout = NULL;
 }
 
-static gboolean pipeline_destroy(gpointer user_data)
+// time from (re)starting, resuming or seeking a pipeline until OBS receives
+// the first frame or audio packet from it
+static void first_frame_mark(data_t *data, enum first_frame_reason reason)
+{
+	data->first_frame_start = g_get_monotonic_time();
+	data->first_frame_reason = reason;
+	g_atomic_int_set(&data->first_frame_pending, 1);
+}
+
+static void first_frame_report(data_t *data)
+{
+	if (!g_atomic_int_get(&data->first_frame_pending) ||
+	    !g_atomic_int_compare_and_exchange(&data->first_frame_pending, 1, 0))
+		return;
+
+	gint64 elapsed = g_get_monotonic_time() - data->first_frame_start;
+	const char *source_name = obs_source_get_name(data->source);
+
+	if (data->first_frame_reason == FIRST_FRAME_SEEK) {
+		blog(LOG_INFO, "[obs-gstreamer] %s: first frame %.1f ms after seek", source_name, elapsed / 1000.0);
+	} else if (data->first_frame_reason == FIRST_FRAME_START) {
+		data->cold_start_time = elapsed;
+		blog(LOG_INFO, "[obs-gstreamer] %s: first frame %.1f ms after start", source_name, elapsed / 1000.0);
+	} else if (data->cold_start_time > 0) {
+		blog(LOG_INFO, "[obs-gstreamer] %s: first frame %.1f ms after standby resume (cold start: %.1f ms)",
+		     source_name, elapsed / 1000.0, data->cold_start_time / 1000.0);
+	} else {
+		blog(LOG_INFO, "[obs-gstreamer] %s: first frame %.1f ms after standby resume", source_name,
+		     elapsed / 1000.0);
+	}
+}
+
+static void seek_settle_destroy(gpointer user_data)
 {
 	data_t *data = user_data;
 
-	if (!data->pipe)
-		return G_SOURCE_REMOVE;
+	g_source_unref(data->seek_settle);
+	data->seek_settle = NULL;
+}
 
-	// reset OBS media flags
-	data->obs_media_state = OBS_MEDIA_STATE_STOPPED;
-	data->seek_pos_pending = -1;
-	data->buffering = false;
+// drop pending and in-flight seeks, they belong to the previous pipeline
+static void seek_reset(data_t *data)
+{
+	if (data->seek_settle)
+		g_source_destroy(data->seek_settle);
 
+	g_atomic_int_set(&data->seek_pending_ms, -1);
+	data->seek_in_flight = false;
+	data->seek_trick = false;
+	data->seek_time = 0;
+}
+
+static void pipeline_free(GstElement *pipe)
+{
 	// stop the bus_callback
-	GstBus *bus = gst_element_get_bus(data->pipe);
+	GstBus *bus = gst_element_get_bus(pipe);
 	gst_bus_remove_watch(bus);
 	gst_object_unref(bus);
 
 	// set state to GST_STATE_NULL here and _only_ here, just before
-	// unreferencing data->pipe
-	gst_element_set_state(data->pipe, GST_STATE_NULL);
+	// unreferencing the pipeline
+	gst_element_set_state(pipe, GST_STATE_NULL);
+
+	gst_object_unref(pipe);
+}
+
+// pipelines waiting for NTP sync are only prerolled, ntp_sync_poll() sets
+// them to PLAYING once the clock is usable
+static void pipeline_set_playing(GstElement *pipe)
+{
+	if (g_object_get_data(G_OBJECT(pipe), "ntp-sync-gate"))
+		gst_element_set_state(pipe, GST_STATE_PAUSED);
+	else
+		gst_element_set_state(pipe, GST_STATE_PLAYING);
+}
+
+static void swap_timeout_destroy(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	g_source_destroy(data->swap_timeout);
+	g_source_unref(data->swap_timeout);
+	data->swap_timeout = NULL;
+}
+
+static void pipeline_pending_destroy(data_t *data)
+{
+	if (data->swap_timeout)
+		g_source_destroy(data->swap_timeout);
+
+	if (!data->pipe_pending)
+		return;
+
+	g_atomic_int_set(&data->pending_generation, 0);
+
+	pipeline_free(data->pipe_pending);
+	data->pipe_pending = NULL;
+}
+
+// position and duration for the OBS media callbacks, which would otherwise
+// query the pipeline on every UI refresh
+static void media_position_reset(data_t *data)
+{
+	g_atomic_int_set(&data->position_ms, 0);
+	g_atomic_int_set(&data->duration_ms, -1);
+}
+
+static void media_duration_update(data_t *data)
+{
+	gint64 duration;
+
+	if (data->pipe && gst_element_query_duration(data->pipe, GST_FORMAT_TIME, &duration) &&
+	    GST_CLOCK_TIME_IS_VALID(duration))
+		g_atomic_int_set(&data->duration_ms, MIN(GST_TIME_AS_MSECONDS(duration), G_MAXINT));
+	else
+		g_atomic_int_set(&data->duration_ms, -1);
+}
+
+// called with every sample handed to OBS
+static void media_position_update(data_t *data, GstSample *sample)
+{
+	GstClockTime pts = GST_BUFFER_PTS(gst_sample_get_buffer(sample));
+	GstClockTime position = gst_segment_to_stream_time(gst_sample_get_segment(sample), GST_FORMAT_TIME, pts);
+
+	if (GST_CLOCK_TIME_IS_VALID(position))
+		g_atomic_int_set(&data->position_ms, MIN(GST_TIME_AS_MSECONDS(position), G_MAXINT));
+}
+
+static gboolean pipeline_destroy(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	pipeline_pending_destroy(data);
 
-	gst_object_unref(data->pipe);
-	if (data->clock != NULL)
-		gst_object_unref(data->clock);
+	if (!data->pipe)
+		return G_SOURCE_REMOVE;
+
+	// reset OBS media flags
+	g_atomic_int_set(&data->obs_media_state, OBS_MEDIA_STATE_STOPPED);
+	seek_reset(data);
+	g_atomic_int_set(&data->buffering, false);
+	media_position_reset(data);
+	data->standby_paused = false;
+	data->standby_probe_video = 0;
+	data->standby_probe_audio = 0;
+
+	pipeline_free(data->pipe);
 	data->pipe = NULL;
-	data->clock = NULL;
+	data->config = NULL;
 
 	return G_SOURCE_REMOVE;
 }
 
+// cold start, OBS gets no frames until the new pipeline is up
+static void pipeline_start(data_t *data)
+{
+	g_atomic_int_set(&data->obs_media_state, OBS_MEDIA_STATE_OPENING);
+	seek_reset(data);
+	g_atomic_int_set(&data->buffering, false);
+	media_position_reset(data);
+
+	data->pipe = create_pipeline(data);
+	if (!data->pipe) {
+		g_atomic_int_set(&data->obs_media_state, OBS_MEDIA_STATE_ERROR);
+
+		obs_source_output_video(data->source, NULL);
+
+		return;
+	}
+
+	data->config = g_object_get_data(G_OBJECT(data->pipe), "config");
+	data->stats_decimated = 0;
+	g_atomic_int_set(&data->active_generation, data->generation);
+}
+
 static gboolean pipeline_restart(gpointer user_data)
 {
 	data_t *data = user_data;
 
-	if (data->pipe)
-		pipeline_destroy(data);
+	pipeline_destroy(data);
+
+	// don't bring a pipeline up while hidden, pipeline_resume() will
+	if (data->standby)
+		return G_SOURCE_REMOVE;
+
+	gstreamer_stats_add(&data->stats, STATS_RESTARTS, 1);
+
+	first_frame_mark(data, FIRST_FRAME_START);
 
-	create_pipeline(data);
+	pipeline_start(data);
 
 	if (data->pipe)
-		gst_element_set_state(data->pipe, GST_STATE_PLAYING);
+		pipeline_set_playing(data->pipe);
+
+	return G_SOURCE_REMOVE;
+}
+
+// called once the pending pipeline delivered its first sample, the appsinks
+// already switched over so this only has to retire the old pipeline
+static gboolean pipeline_swap(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	if (!data->pipe_pending || g_atomic_int_get(&data->active_generation) != data->pipe_pending_generation)
+		return G_SOURCE_REMOVE;
+
+	if (data->swap_timeout)
+		g_source_destroy(data->swap_timeout);
+
+	GstElement *pipe = data->pipe;
+
+	data->pipe = data->pipe_pending;
+	data->pipe_pending = NULL;
+	data->config = g_object_get_data(G_OBJECT(data->pipe), "config");
+	data->stats_decimated = 0;
+
+	g_atomic_int_set(&data->obs_media_state, OBS_MEDIA_STATE_PLAYING);
+	seek_reset(data);
+	g_atomic_int_set(&data->buffering, false);
+	media_position_reset(data);
+	media_duration_update(data);
+
+	const char *source_name = obs_source_get_name(data->source);
+	blog(LOG_INFO, "[obs-gstreamer] %s: switched to updated pipeline after %.1f ms", source_name,
+	     (g_get_monotonic_time() - data->pipe_pending_start) / 1000.0);
+
+	if (pipe)
+		pipeline_free(pipe);
+
+	return G_SOURCE_REMOVE;
+}
+
+// give up on the pending pipeline and keep the current one running, unless
+// an appsink of the pending pipeline just claimed the switch
+static void pipeline_pending_abandon(data_t *data, const char *reason)
+{
+	if (!data->pipe_pending)
+		return;
+
+	if (!g_atomic_int_compare_and_exchange(&data->pending_generation, data->pipe_pending_generation, 0)) {
+		// the appsink may not have published the switch yet
+		g_atomic_int_set(&data->active_generation, data->pipe_pending_generation);
+		pipeline_swap(data);
+		return;
+	}
+
+	const char *source_name = obs_source_get_name(data->source);
+	blog(LOG_WARNING, "[obs-gstreamer] %s: keeping the running pipeline, updated pipeline %s", source_name,
+	     reason);
+
+	pipeline_pending_destroy(data);
+}
+
+static gboolean pipeline_swap_timeout(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	// a pipeline that made it to PLAYING but has not produced anything yet is
+	// still what the user asked for
+	GstState state = GST_STATE_NULL;
+	gst_element_get_state(data->pipe_pending, &state, NULL, 0);
+
+	if (state == GST_STATE_PLAYING &&
+	    g_atomic_int_compare_and_exchange(&data->pending_generation, data->pipe_pending_generation, 0))
+		g_atomic_int_set(&data->active_generation, data->pipe_pending_generation);
+
+	if (g_atomic_int_get(&data->active_generation) == data->pipe_pending_generation)
+		pipeline_swap(data);
+	else
+		pipeline_pending_abandon(data, "did not start in time");
+
+	return G_SOURCE_REMOVE;
+}
+
+// build the pipeline for updated settings next to the running one. OBS keeps
+// getting frames from the old pipeline until the new one delivers.
+static gboolean pipeline_prepare(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	if (data->standby || !data->pipe)
+		return pipeline_restart(data);
+
+	// superseded by a newer update. one that already took over from the
+	// running pipeline is what OBS shows now and becomes the running one.
+	if (data->pipe_pending &&
+	    !g_atomic_int_compare_and_exchange(&data->pending_generation, data->pipe_pending_generation, 0)) {
+		g_atomic_int_set(&data->active_generation, data->pipe_pending_generation);
+		pipeline_swap(data);
+	}
+	pipeline_pending_destroy(data);
+
+	GstElement *pipe = create_pipeline(data);
+	if (!pipe)
+		return G_SOURCE_REMOVE;
+
+	data->pipe_pending = pipe;
+	data->pipe_pending_generation = data->generation;
+	data->pipe_pending_start = g_get_monotonic_time();
+	g_atomic_int_set(&data->pending_generation, data->generation);
+
+	data->swap_timeout = g_timeout_source_new_seconds(10);
+	g_source_set_callback(data->swap_timeout, pipeline_swap_timeout, data, swap_timeout_destroy);
+	g_source_attach(data->swap_timeout, g_main_context_get_thread_default());
+
+	pipeline_set_playing(pipe);
 
 	return G_SOURCE_REMOVE;
 }
@@ -104,7 +547,7 @@ static void update_obs_media_state(GstMessage *message, data_t *data)
 	case GST_MESSAGE_BUFFERING: {
 		gint percent;
 		gst_message_parse_buffering(message, &percent);
-		data->buffering = (percent < 100);
+		g_atomic_int_set(&data->buffering, percent < 100);
 	} break;
 	case GST_MESSAGE_STATE_CHANGED: {
 		GstState newstate;
@@ -113,38 +556,97 @@ static void update_obs_media_state(GstMessage *message, data_t *data)
 		default:
 		case GST_STATE_NULL:
 			blog(LOG_WARNING, "[obs-gstreamer] state is GST_STATE_NULL, unexpected.");
-			data->obs_media_state = OBS_MEDIA_STATE_NONE;
+			g_atomic_int_set(&data->obs_media_state, OBS_MEDIA_STATE_NONE);
 			break;
 		case GST_STATE_READY:
-			data->obs_media_state = OBS_MEDIA_STATE_STOPPED;
+			g_atomic_int_set(&data->obs_media_state, OBS_MEDIA_STATE_STOPPED);
 			break;
 		case GST_STATE_PAUSED:
-			data->obs_media_state = OBS_MEDIA_STATE_PAUSED;
+			g_atomic_int_set(&data->obs_media_state, OBS_MEDIA_STATE_PAUSED);
 			break;
 		case GST_STATE_PLAYING:
-			data->obs_media_state = OBS_MEDIA_STATE_PLAYING;
+			g_atomic_int_set(&data->obs_media_state, OBS_MEDIA_STATE_PLAYING);
 			break;
 		}
 	} break;
 	case GST_MESSAGE_ERROR: {
-		data->obs_media_state = OBS_MEDIA_STATE_ERROR;
+		g_atomic_int_set(&data->obs_media_state, OBS_MEDIA_STATE_ERROR);
 	} break;
 	case GST_MESSAGE_EOS: {
-		data->obs_media_state = OBS_MEDIA_STATE_ENDED;
+		g_atomic_int_set(&data->obs_media_state, OBS_MEDIA_STATE_ENDED);
 	} break;
 	default:
 		break;
 	}
 }
 
+// looping plays the media as a segment. SEGMENT_DONE seeks back to the start
+// without flushing, so running time and time stamps keep increasing.
+static void pipeline_loop(data_t *data, GstElement *pipe, GstMessage *message)
+{
+	const config_t *config = g_object_get_data(G_OBJECT(pipe), "config");
+
+	if (!config->loop)
+		return;
+
+	switch (GST_MESSAGE_TYPE(message)) {
+	case GST_MESSAGE_ASYNC_DONE:
+		// the initial segment seek, once the pipeline prerolled
+		if (g_object_get_data(G_OBJECT(pipe), "loop-started"))
+			break;
+		g_object_set_data(G_OBJECT(pipe), "loop-started", GINT_TO_POINTER(1));
+
+		if (!gst_element_seek(pipe, 1.0, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_SEGMENT,
+				      GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE)) {
+			const char *source_name = obs_source_get_name(data->source);
+			blog(LOG_WARNING, "[obs-gstreamer] %s: Cannot loop, pipeline is not seekable", source_name);
+		}
+		break;
+	case GST_MESSAGE_SEGMENT_DONE:
+		gst_element_seek(pipe, 1.0, GST_FORMAT_TIME, GST_SEEK_FLAG_SEGMENT, GST_SEEK_TYPE_SET, 0,
+				 GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+		break;
+	default:
+		break;
+	}
+}
+
 static gboolean bus_callback(GstBus *bus, GstMessage *message, gpointer user_data)
 {
 	data_t *data = user_data;
 
+	// the pipeline prepared for updated settings does not affect the OBS
+	// media state until it takes over
+	if (data->pipe_pending && bus == GST_ELEMENT_BUS(data->pipe_pending)) {
+		pipeline_loop(data, data->pipe_pending, message);
+
+		if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+			gstreamer_stats_add(&data->stats, STATS_ERRORS, 1);
+
+			GError *err;
+			gst_message_parse_error(message, &err, NULL);
+			const char *source_name = obs_source_get_name(data->source);
+			blog(LOG_ERROR, "[obs-gstreamer] %s: %s", source_name, err->message);
+			g_error_free(err);
+
+			pipeline_pending_abandon(data, "failed");
+		}
+		return TRUE;
+	}
+
+	if (!data->pipe || bus != GST_ELEMENT_BUS(data->pipe))
+		return TRUE;
+
+	const config_t *config = data->config;
+
 	update_obs_media_state(message, data);
 
+	pipeline_loop(data, data->pipe, message);
+
 	switch (GST_MESSAGE_TYPE(message)) {
 	case GST_MESSAGE_ERROR: {
+		gstreamer_stats_add(&data->stats, STATS_ERRORS, 1);
+
 		GError *err;
 		gst_message_parse_error(message, &err, NULL);
 		const char *source_name = obs_source_get_name(data->source);
@@ -152,13 +654,12 @@ static gboolean bus_callback(GstBus *bus, GstMessage *message, gpointer user_dat
 		g_error_free(err);
 	} // fallthrough
 	case GST_MESSAGE_EOS:
-		if (obs_data_get_bool(data->settings, "clear_on_end"))
+		if (config->clear_on_end)
 			obs_source_output_video(data->source, NULL);
-		if (obs_data_get_bool(data->settings, GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR
-							      ? "restart_on_error"
-							      : "restart_on_eos") &&
+		if ((GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR ? config->restart_on_error
+								    : config->restart_on_eos) &&
 		    data->timeout == NULL) {
-			data->timeout = g_timeout_source_new(obs_data_get_int(data->settings, "restart_timeout"));
+			data->timeout = g_timeout_source_new(config->restart_timeout);
 			g_source_set_callback(data->timeout, pipeline_restart, data, timeout_destroy);
 			g_source_attach(data->timeout, g_main_context_get_thread_default());
 		}
@@ -170,6 +671,24 @@ static gboolean bus_callback(GstBus *bus, GstMessage *message, gpointer user_dat
 		blog(LOG_WARNING, "[obs-gstreamer] %s: %s", source_name, err->message);
 		g_error_free(err);
 	} break;
+	case GST_MESSAGE_QOS:
+		// elements skipping frames on the QoS events of the video appsink.
+		// the appsinks never drop late buffers themselves.
+		if (!g_str_has_suffix(GST_MESSAGE_SRC_NAME(message), "_appsink"))
+			gstreamer_stats_add(&data->stats, STATS_QOS_SKIPPED, 1);
+		break;
+	case GST_MESSAGE_DURATION_CHANGED:
+		media_duration_update(data);
+		break;
+	case GST_MESSAGE_ASYNC_DONE:
+		media_duration_update(data);
+
+		// the seek completed, run the latest position requested meanwhile
+		if (data->seek_in_flight) {
+			data->seek_in_flight = false;
+			pipeline_seek_to_pending(data);
+		}
+		break;
 	default:
 		break;
 	}
@@ -177,187 +696,507 @@ static gboolean bus_callback(GstBus *bus, GstMessage *message, gpointer user_dat
 	return TRUE;
 }
 
-static GstFlowReturn video_new_sample(GstAppSink *appsink, gpointer user_data)
-{
-	data_t *data = user_data;
-	GstSample *sample = gst_app_sink_pull_sample(appsink);
-	GstBuffer *buffer = gst_sample_get_buffer(sample);
-	GstCaps *caps = gst_sample_get_caps(sample);
-	GstMapInfo info;
-	GstVideoInfo video_info;
-
-	gst_video_info_from_caps(&video_info, caps);
-	gst_buffer_map(buffer, &info, GST_MAP_READ);
+// per-appsink state, the frame template is only rebuilt when the caps change.
+// config belongs to the appsink's pipeline and lives as long as it does.
+typedef struct {
+	data_t *data;
+	const config_t *config;
+	gint generation;
+	gint64 frame_count;
+	bool hash_valid;
+	guint64 hash;
+	gint64 delivered_time;
+	GstCaps *caps;
+	GstVideoInfo info;
+	struct obs_source_frame frame;
+} video_sink_t;
 
-	struct obs_source_frame frame = {};
+typedef struct {
+	data_t *data;
+	const config_t *config;
+	gint generation;
+	bool anchored;
+	GstClockTime anchor;
+	guint64 samples;
+	GstClockTimeDiff drift;
+	GstCaps *caps;
+	GstAudioInfo info;
+	struct obs_source_audio audio;
+} audio_sink_t;
+
+// whether samples of the given pipeline generation should reach OBS. the
+// first sample of a pending pipeline switches OBS over to it, after that
+// samples still coming from the old pipeline are discarded.
+static bool pipeline_is_active(data_t *data, gint generation)
+{
+	gint active = g_atomic_int_get(&data->active_generation);
 
-	frame.timestamp = obs_data_get_bool(data->settings, "use_timestamps_video") ? GST_BUFFER_PTS(buffer)
-										    : data->frame_count++;
+	if (generation == active)
+		return true;
 
-	frame.width = video_info.width;
-	frame.height = video_info.height;
-	frame.linesize[0] = video_info.stride[0];
-	frame.linesize[1] = video_info.stride[1];
-	frame.linesize[2] = video_info.stride[2];
-	frame.data[0] = info.data + video_info.offset[0];
-	frame.data[1] = info.data + video_info.offset[1];
-	frame.data[2] = info.data + video_info.offset[2];
+	if (generation < active || !g_atomic_int_compare_and_exchange(&data->pending_generation, generation, 0))
+		return false;
 
-	enum video_range_type range = VIDEO_RANGE_DEFAULT;
-	switch (video_info.colorimetry.range) {
-	case GST_VIDEO_COLOR_RANGE_0_255:
-		range = VIDEO_RANGE_FULL;
-		frame.full_range = 1;
-		break;
-	case GST_VIDEO_COLOR_RANGE_16_235:
-		range = VIDEO_RANGE_PARTIAL;
-		break;
-	default:
-		break;
-	}
+	g_atomic_int_set(&data->active_generation, generation);
 
-	enum video_colorspace cs = VIDEO_CS_DEFAULT;
-	switch (video_info.colorimetry.matrix) {
-	case GST_VIDEO_COLOR_MATRIX_BT709:
-		cs = VIDEO_CS_709;
-		break;
-	case GST_VIDEO_COLOR_MATRIX_BT601:
-		cs = VIDEO_CS_601;
-		break;
-	default:
-		break;
-	}
+	g_main_context_invoke(data->worker->context, pipeline_swap, data);
 
-	video_format_get_parameters(cs, range, frame.color_matrix, frame.color_range_min, frame.color_range_max);
+	return true;
+}
 
-	switch (video_info.finfo->format) {
-	case GST_VIDEO_FORMAT_I420:
-		frame.format = VIDEO_FORMAT_I420;
-		break;
-	case GST_VIDEO_FORMAT_NV12:
-		frame.format = VIDEO_FORMAT_NV12;
-		break;
-	case GST_VIDEO_FORMAT_BGRA:
-		frame.format = VIDEO_FORMAT_BGRA;
-		break;
-	case GST_VIDEO_FORMAT_BGRx:
-		frame.format = VIDEO_FORMAT_BGRX;
-		break;
-	case GST_VIDEO_FORMAT_RGBx:
-	case GST_VIDEO_FORMAT_RGBA:
-		frame.format = VIDEO_FORMAT_RGBA;
-		break;
-	case GST_VIDEO_FORMAT_UYVY:
-		frame.format = VIDEO_FORMAT_UYVY;
-		break;
-	case GST_VIDEO_FORMAT_YUY2:
-		frame.format = VIDEO_FORMAT_YUY2;
-		break;
-	case GST_VIDEO_FORMAT_YVYU:
-		frame.format = VIDEO_FORMAT_YVYU;
-		break;
-#ifdef GST_VIDEO_FORMAT_I420_10LE
-	case GST_VIDEO_FORMAT_I420_10LE:
-		frame.format = VIDEO_FORMAT_I010;
-		break;
-	case GST_VIDEO_FORMAT_P010_10LE:
-		frame.format = VIDEO_FORMAT_P010;
-		break;
-	case GST_VIDEO_FORMAT_I422_10LE:
-		frame.format = VIDEO_FORMAT_I210;
-		break;
-	case GST_VIDEO_FORMAT_Y444_12LE:
-		frame.format = VIDEO_FORMAT_I412;
-		break;
-#endif
-	default:
-		frame.format = VIDEO_FORMAT_NONE;
-		const char *source_name = obs_source_get_name(data->source);
-		blog(LOG_ERROR, "[obs-gstreamer] %s: Unknown video format: %s", source_name, video_info.finfo->name);
-		break;
-	}
+static void video_sink_free(gpointer user_data)
+{
+	video_sink_t *sink = user_data;
 
-	obs_source_output_video(data->source, &frame);
+	gst_caps_replace(&sink->caps, NULL);
+	g_free(sink);
+}
 
-	gst_buffer_unmap(buffer, &info);
-	gst_sample_unref(sample);
+static void audio_sink_free(gpointer user_data)
+{
+	audio_sink_t *sink = user_data;
 
-	return GST_FLOW_OK;
+	gst_caps_replace(&sink->caps, NULL);
+	g_free(sink);
 }
 
-static GstFlowReturn audio_new_sample(GstAppSink *appsink, gpointer user_data)
+// formats OBS takes as they are. the caps of the video appsink are built from
+// this table, so anything videoconvert negotiates has a mapping and it passes
+// through whenever upstream already produces one of them.
+static const struct {
+	GstVideoFormat gst;
+	enum video_format obs;
+} video_formats[] = {
+	{GST_VIDEO_FORMAT_I420, VIDEO_FORMAT_I420},
+	{GST_VIDEO_FORMAT_NV12, VIDEO_FORMAT_NV12},
+	{GST_VIDEO_FORMAT_BGRA, VIDEO_FORMAT_BGRA},
+	{GST_VIDEO_FORMAT_BGRx, VIDEO_FORMAT_BGRX},
+	{GST_VIDEO_FORMAT_RGBx, VIDEO_FORMAT_RGBA},
+	{GST_VIDEO_FORMAT_RGBA, VIDEO_FORMAT_RGBA},
+	{GST_VIDEO_FORMAT_YUY2, VIDEO_FORMAT_YUY2},
+	{GST_VIDEO_FORMAT_YVYU, VIDEO_FORMAT_YVYU},
+	{GST_VIDEO_FORMAT_UYVY, VIDEO_FORMAT_UYVY},
+	{GST_VIDEO_FORMAT_Y42B, VIDEO_FORMAT_I422},
+	{GST_VIDEO_FORMAT_Y444, VIDEO_FORMAT_I444},
+	{GST_VIDEO_FORMAT_GRAY8, VIDEO_FORMAT_Y800},
+	{GST_VIDEO_FORMAT_BGR, VIDEO_FORMAT_BGR3},
+#if LIBOBS_API_MAJOR_VER >= 27
+	{GST_VIDEO_FORMAT_A420, VIDEO_FORMAT_I40A},
+	// byte order V, U, Y, A, the AYUV of Microsoft's FOURCC
+	{GST_VIDEO_FORMAT_VUYA, VIDEO_FORMAT_AYUV},
+#if GST_CHECK_VERSION(1, 24, 0)
+	{GST_VIDEO_FORMAT_A422, VIDEO_FORMAT_I42A},
+	{GST_VIDEO_FORMAT_A444, VIDEO_FORMAT_YUVA},
+#endif
+#endif
+#if LIBOBS_API_MAJOR_VER >= 28
+	{GST_VIDEO_FORMAT_I420_10LE, VIDEO_FORMAT_I010},
+	{GST_VIDEO_FORMAT_P010_10LE, VIDEO_FORMAT_P010},
+	{GST_VIDEO_FORMAT_I422_10LE, VIDEO_FORMAT_I210},
+	{GST_VIDEO_FORMAT_Y444_12LE, VIDEO_FORMAT_I412},
+#if GST_CHECK_VERSION(1, 24, 0)
+	{GST_VIDEO_FORMAT_A444_12LE, VIDEO_FORMAT_YA2L},
+#endif
+#endif
+#if LIBOBS_API_MAJOR_VER >= 30
+	{GST_VIDEO_FORMAT_v210, VIDEO_FORMAT_V210},
+	// x2 R10 G10 B10 in a little endian word
+	{GST_VIDEO_FORMAT_BGR10A2_LE, VIDEO_FORMAT_R10L},
+#endif
+};
+
+static enum video_format video_format_to_obs(GstVideoFormat format)
 {
-	data_t *data = user_data;
-	GstSample *sample = gst_app_sink_pull_sample(appsink);
-	GstBuffer *buffer = gst_sample_get_buffer(sample);
-	GstCaps *caps = gst_sample_get_caps(sample);
-	GstMapInfo info;
-	GstAudioInfo audio_info;
+	for (size_t i = 0; i < G_N_ELEMENTS(video_formats); i++) {
+		if (video_formats[i].gst == format)
+			return video_formats[i].obs;
+	}
 
-	gst_audio_info_from_caps(&audio_info, caps);
-	gst_buffer_map(buffer, &info, GST_MAP_READ);
+	return VIDEO_FORMAT_NONE;
+}
+
+// "I420,NV12,..." for the caps of the video appsink
+static gchar *video_formats_list(void)
+{
+	GString *list = g_string_new(NULL);
+
+	for (size_t i = 0; i < G_N_ELEMENTS(video_formats); i++) {
+		if (i > 0)
+			g_string_append_c(list, ',');
+		g_string_append(list, gst_video_format_to_string(video_formats[i].gst));
+	}
+
+	return g_string_free(list, FALSE);
+}
+
+// the user's pipeline links to the first of the plugin's video elements as
+// "video", the others get their own names
+static void video_branch_add(GString *branch, const char *element, const char *name)
+{
+	if (branch->len == 0)
+		g_string_append_printf(branch, "%s name=video", element);
+	else
+		g_string_append_printf(branch, " ! %s name=%s", element, name);
+}
+
+static GstElement *video_branch_get(GstElement *pipe, const char *name)
+{
+	GstElement *element = gst_bin_get_by_name(GST_BIN(pipe), name);
+
+	return element ? element : gst_bin_get_by_name(GST_BIN(pipe), "video");
+}
+
+static gchar *video_branch(obs_data_t *settings)
+{
+	GString *branch = g_string_new(NULL);
+
+	// drop frames OBS would not show before anything else works on them.
+	// videorate keeps the frame closest to each canvas tick.
+	struct obs_video_info ovi;
+	if (obs_data_get_bool(settings, "limit_fps") && obs_get_video_info(&ovi)) {
+		video_branch_add(branch, "videorate drop-only=true", "video_rate");
+		g_string_append_printf(branch, " ! video/x-raw, framerate=(fraction)[0/1, %u/%u]", ovi.fps_num,
+				       ovi.fps_den);
+	}
+
+	// scale before converting so that only the pixels OBS draws are converted
+	if (strlen(obs_data_get_string(settings, "scale_mode")) > 0 ||
+	    strcmp(obs_data_get_string(settings, "inactive_mode"), "resolution") == 0) {
+		video_branch_add(branch, "videoscale add-borders=false", "video_scale");
+		video_branch_add(branch, "capsfilter", "video_scale_caps");
+	}
+
+	GString *convert = g_string_new("videoconvert");
+
+	gint threads = obs_data_get_int(settings, "convert_threads");
+	if (threads > 0)
+		g_string_append_printf(convert, " n-threads=%d", threads);
+
+	const char *quality = obs_data_get_string(settings, "convert_quality");
+	if (g_strcmp0(quality, "fast") == 0)
+		g_string_append(convert, " dither=none chroma-resampler=linear");
+	else if (g_strcmp0(quality, "high") == 0)
+		g_string_append(convert, " dither=floyd-steinberg chroma-resampler=sinc");
+
+	video_branch_add(branch, convert->str, "video_convert");
+	g_string_free(convert, TRUE);
+
+	gchar *formats = video_formats_list();
+	g_string_append_printf(branch, " ! video/x-raw, format={%s} ! appsink name=video_appsink ", formats);
+	g_free(formats);
+
+	return g_string_free(branch, FALSE);
+}
+
+static void video_sink_set_caps(video_sink_t *sink, GstCaps *caps)
+{
+	struct obs_source_frame *frame = &sink->frame;
+
+	gst_caps_replace(&sink->caps, caps);
+	gst_video_info_from_caps(&sink->info, caps);
+
+	sink->hash_valid = false;
+
+	memset(frame, 0, sizeof(*frame));
+
+	frame->width = sink->info.width;
+	frame->height = sink->info.height;
+	for (guint i = 0; i < GST_VIDEO_INFO_N_PLANES(&sink->info); i++)
+		frame->linesize[i] = sink->info.stride[i];
+
+	enum video_range_type range = VIDEO_RANGE_DEFAULT;
+	switch (sink->info.colorimetry.range) {
+	case GST_VIDEO_COLOR_RANGE_0_255:
+		range = VIDEO_RANGE_FULL;
+		frame->full_range = 1;
+		break;
+	case GST_VIDEO_COLOR_RANGE_16_235:
+		range = VIDEO_RANGE_PARTIAL;
+		break;
+	default:
+		break;
+	}
+
+	enum video_colorspace cs = VIDEO_CS_DEFAULT;
+	switch (sink->info.colorimetry.matrix) {
+	case GST_VIDEO_COLOR_MATRIX_BT709:
+		cs = VIDEO_CS_709;
+		break;
+	case GST_VIDEO_COLOR_MATRIX_BT601:
+		cs = VIDEO_CS_601;
+		break;
+	default:
+		break;
+	}
+
+	video_format_get_parameters(cs, range, frame->color_matrix, frame->color_range_min, frame->color_range_max);
+
+	frame->format = video_format_to_obs(sink->info.finfo->format);
+	if (frame->format == VIDEO_FORMAT_NONE) {
+		const char *source_name = obs_source_get_name(sink->data->source);
+		blog(LOG_ERROR, "[obs-gstreamer] %s: Unknown video format: %s", source_name, sink->info.finfo->name);
+	}
+}
+
+static void audio_sink_set_caps(audio_sink_t *sink, GstCaps *caps)
+{
+	struct obs_source_audio *audio = &sink->audio;
 
-	struct obs_source_audio audio = {};
+	// the sample count continues at the new rate
+	if (sink->info.rate > 0) {
+		sink->anchor += gst_util_uint64_scale(sink->samples, GST_SECOND, sink->info.rate);
+		sink->samples = 0;
+	}
+
+	gst_caps_replace(&sink->caps, caps);
+	gst_audio_info_from_caps(&sink->info, caps);
 
-	audio.frames = info.size / audio_info.bpf;
-	audio.samples_per_sec = audio_info.rate;
-	audio.data[0] = info.data;
+	memset(audio, 0, sizeof(*audio));
 
-	audio.timestamp = obs_data_get_bool(data->settings, "use_timestamps_audio")
-				  ? GST_BUFFER_PTS(buffer)
-				  : data->audio_count++ * GST_SECOND * (audio.frames / (double)audio_info.rate);
+	audio->samples_per_sec = sink->info.rate;
 
-	switch (audio_info.channels) {
+	switch (sink->info.channels) {
 	case 1:
-		audio.speakers = SPEAKERS_MONO;
+		audio->speakers = SPEAKERS_MONO;
 		break;
 	case 2:
-		audio.speakers = SPEAKERS_STEREO;
+		audio->speakers = SPEAKERS_STEREO;
 		break;
 	case 3:
-		audio.speakers = SPEAKERS_2POINT1;
+		audio->speakers = SPEAKERS_2POINT1;
 		break;
 	case 4:
-		audio.speakers = SPEAKERS_4POINT0;
+		audio->speakers = SPEAKERS_4POINT0;
 		break;
 	case 5:
-		audio.speakers = SPEAKERS_4POINT1;
+		audio->speakers = SPEAKERS_4POINT1;
 		break;
 	case 6:
-		audio.speakers = SPEAKERS_5POINT1;
+		audio->speakers = SPEAKERS_5POINT1;
 		break;
 	case 8:
-		audio.speakers = SPEAKERS_7POINT1;
+		audio->speakers = SPEAKERS_7POINT1;
 		break;
 	default:
-		audio.speakers = SPEAKERS_UNKNOWN;
-		const char *source_name = obs_source_get_name(data->source);
+		audio->speakers = SPEAKERS_UNKNOWN;
+		const char *source_name = obs_source_get_name(sink->data->source);
 		blog(LOG_ERROR, "[obs-gstreamer] %s: Unsupported audio channel count: %d", source_name,
-		     audio_info.channels);
+		     sink->info.channels);
 		break;
 	}
 
-	switch (audio_info.finfo->format) {
+	bool planar = GST_AUDIO_INFO_LAYOUT(&sink->info) == GST_AUDIO_LAYOUT_NON_INTERLEAVED;
+
+	switch (sink->info.finfo->format) {
 	case GST_AUDIO_FORMAT_U8:
-		audio.format = AUDIO_FORMAT_U8BIT;
+		audio->format = planar ? AUDIO_FORMAT_U8BIT_PLANAR : AUDIO_FORMAT_U8BIT;
 		break;
 	case GST_AUDIO_FORMAT_S16LE:
-		audio.format = AUDIO_FORMAT_16BIT;
+		audio->format = planar ? AUDIO_FORMAT_16BIT_PLANAR : AUDIO_FORMAT_16BIT;
 		break;
 	case GST_AUDIO_FORMAT_S32LE:
-		audio.format = AUDIO_FORMAT_32BIT;
+		audio->format = planar ? AUDIO_FORMAT_32BIT_PLANAR : AUDIO_FORMAT_32BIT;
 		break;
 	case GST_AUDIO_FORMAT_F32LE:
-		audio.format = AUDIO_FORMAT_FLOAT;
+		audio->format = planar ? AUDIO_FORMAT_FLOAT_PLANAR : AUDIO_FORMAT_FLOAT;
 		break;
 	default:
-		audio.format = AUDIO_FORMAT_UNKNOWN;
-		const char *source_name = obs_source_get_name(data->source);
-		blog(LOG_ERROR, "[obs-gstreamer] %s: Unknown audio format: %s", source_name, audio_info.finfo->name);
+		audio->format = AUDIO_FORMAT_UNKNOWN;
+		const char *source_name = obs_source_get_name(sink->data->source);
+		blog(LOG_ERROR, "[obs-gstreamer] %s: Unknown audio format: %s", source_name, sink->info.finfo->name);
 		break;
 	}
+}
+
+// the buffer time stamp mapped through the segment to running time plus base
+// time, the clock time the sample is due. unlike the buffer time stamps this
+// continues across seeks, segment changes and loop iterations. on the OBS
+// clock it is OBS time already.
+static GstClockTime sample_timestamp(GstAppSink *appsink, GstSample *sample)
+{
+	GstClockTime pts = GST_BUFFER_PTS(gst_sample_get_buffer(sample));
+	GstClockTime running_time = gst_segment_to_running_time(gst_sample_get_segment(sample), GST_FORMAT_TIME, pts);
+
+	if (!GST_CLOCK_TIME_IS_VALID(running_time))
+		return GST_CLOCK_TIME_NONE;
+
+	return running_time + gst_element_get_base_time(GST_ELEMENT(appsink)) +
+	       gst_base_sink_get_latency(GST_BASE_SINK(appsink));
+}
+
+// how much later than it was due a sample reached OBS. a synced appsink only
+// renders at running time plus the pipeline latency and render delay, below
+// that a sample is in time.
+static GstClockTimeDiff sample_lateness(GstAppSink *appsink, GstClockTimeDiff latency)
+{
+	GstBaseSink *sink = GST_BASE_SINK(appsink);
+
+	if (latency == GST_CLOCK_STIME_NONE || !gst_base_sink_get_sync(sink))
+		return latency;
+
+	return latency - (GstClockTimeDiff)(gst_base_sink_get_latency(sink) + gst_base_sink_get_render_delay(sink));
+}
+
+// time from when the sample was due according to the pipeline clock until it
+// reaches OBS, GST_CLOCK_STIME_NONE if unknown
+static GstClockTimeDiff sample_latency(data_t *data, GstAppSink *appsink, GstSample *sample, GstClockTime *running_time)
+{
+	GstClockTime pts = GST_BUFFER_PTS(gst_sample_get_buffer(sample));
+	GstClock *clock = gst_element_get_clock(GST_ELEMENT(appsink));
+	GstClockTimeDiff latency = GST_CLOCK_STIME_NONE;
+
+	*running_time = GST_CLOCK_TIME_NONE;
+
+	if (clock == NULL || !GST_CLOCK_TIME_IS_VALID(pts)) {
+		if (clock)
+			gst_object_unref(clock);
+		return latency;
+	}
+
+	GstClockTime now = gst_clock_get_time(clock) - gst_element_get_base_time(GST_ELEMENT(appsink));
+	*running_time = gst_segment_to_running_time(gst_sample_get_segment(sample), GST_FORMAT_TIME, pts);
+
+	if (GST_CLOCK_TIME_IS_VALID(*running_time)) {
+		latency = GST_CLOCK_DIFF(*running_time, now);
+		gstreamer_stats_latency(&data->stats, latency);
+
+		// a synced appsink waits for the sample to be due, more than a
+		// little scheduling delay after that means the pipeline latency is
+		// too low
+		if (gst_base_sink_get_sync(GST_BASE_SINK(appsink)) &&
+		    sample_lateness(appsink, latency) > 15 * GST_MSECOND)
+			g_atomic_int_inc(&data->late_samples);
+	}
+
+	gst_object_unref(clock);
+
+	return latency;
+}
+
+// OBS paces async frames by their time stamps on the same clock, so a frame
+// that reaches it late has no chance to be shown in time. tell upstream, so
+// that decoders can skip frames until they caught up. nothing is sent while
+// frames are in time, decoders stop skipping once the reported time passed.
+static void video_qos(GstAppSink *appsink, GstBuffer *buffer, GstClockTime running_time, GstClockTimeDiff lateness)
+{
+	if (!GST_CLOCK_TIME_IS_VALID(running_time) || lateness == GST_CLOCK_STIME_NONE)
+		return;
+
+	GstClockTime duration = GST_BUFFER_DURATION(buffer);
+	GstClockTimeDiff threshold = GST_CLOCK_TIME_IS_VALID(duration) ? duration / 2 : 20 * GST_MSECOND;
+
+	if (lateness <= threshold)
+		return;
+
+	GstEvent *event = gst_event_new_qos(GST_QOS_TYPE_UNDERFLOW, 1.0, lateness, running_time);
+
+	GstPad *pad = gst_element_get_static_pad(GST_ELEMENT(appsink), "sink");
+	gst_pad_push_event(pad, event);
+	gst_object_unref(pad);
+}
+
+// fingerprint of the whole frame. four independent lanes keep the multiplies
+// from waiting on each other, so this runs at about the speed of reading the
+// memory once, less than converting and copying the frame would cost.
+static guint64 frame_hash(const guint8 *data, gsize size)
+{
+	guint64 lanes[4] = {0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull, 0x27d4eb2f165667c5ull};
+	gsize i = 0;
+
+	for (; i + 32 <= size; i += 32) {
+		for (int l = 0; l < 4; l++) {
+			guint64 word;
+			memcpy(&word, data + i + l * 8, 8);
+			lanes[l] ^= word;
+			lanes[l] = ((lanes[l] << 31) | (lanes[l] >> 33)) * 0x9e3779b97f4a7c15ull;
+		}
+	}
+
+	guint64 hash = lanes[0] ^ (lanes[1] * 3) ^ (lanes[2] * 5) ^ (lanes[3] * 7) ^ size;
+
+	for (; i < size; i++)
+		hash = (hash ^ data[i]) * 0x100000001b3ull;
+
+	return hash;
+}
+
+// whether the frame shows the same as the last one handed to OBS. OBS keeps
+// showing that one, but gets a frame every keep-alive interval regardless.
+static bool video_frame_unchanged(video_sink_t *sink, GstBuffer *buffer, const GstMapInfo *info)
+{
+	// upstream marks buffers without new content as gaps, their data is no
+	// picture to show, not even for a keep-alive
+	if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_GAP))
+		return true;
+
+	gint64 now = g_get_monotonic_time();
+	bool keepalive = now - sink->delivered_time >= sink->config->keepalive_interval * (gint64)1000;
+	guint64 hash = frame_hash(info->data, info->size);
+
+	if (sink->hash_valid && hash == sink->hash && !keepalive)
+		return true;
+
+	sink->hash_valid = true;
+	sink->hash = hash;
+	sink->delivered_time = now;
+
+	return false;
+}
+
+static GstFlowReturn video_new_sample(GstAppSink *appsink, gpointer user_data)
+{
+	video_sink_t *sink = user_data;
+	data_t *data = sink->data;
+	GstSample *sample = gst_app_sink_pull_sample(appsink);
+	GstBuffer *buffer = gst_sample_get_buffer(sample);
+	GstCaps *caps = gst_sample_get_caps(sample);
+	GstMapInfo info;
+
+	if (!pipeline_is_active(data, sink->generation)) {
+		gst_sample_unref(sample);
+		return GST_FLOW_OK;
+	}
 
-	obs_source_output_audio(data->source, &audio);
+	// the sample holds the appsink's current caps, so pointer equality is
+	// enough to tell whether a caps event came through since the last buffer
+	if (caps != sink->caps)
+		video_sink_set_caps(sink, caps);
+
+	gst_buffer_map(buffer, &info, GST_MAP_READ);
+
+	if (sink->config->skip_unchanged && video_frame_unchanged(sink, buffer, &info)) {
+		gstreamer_stats_add(&data->stats, STATS_SUPPRESSED, 1);
+
+		gst_buffer_unmap(buffer, &info);
+		gst_sample_unref(sample);
+
+		return GST_FLOW_OK;
+	}
+
+	struct obs_source_frame *frame = &sink->frame;
+
+	if (sink->config->use_timestamps_video) {
+		frame->timestamp = sample_timestamp(appsink, sample);
+		if (!GST_CLOCK_TIME_IS_VALID(frame->timestamp))
+			frame->timestamp = GST_BUFFER_PTS(buffer);
+	} else {
+		frame->timestamp = sink->frame_count++;
+	}
+
+	for (guint i = 0; i < GST_VIDEO_INFO_N_PLANES(&sink->info); i++)
+		frame->data[i] = info.data + sink->info.offset[i];
+
+	obs_source_output_video(data->source, frame);
+	media_position_update(data, sample);
+
+	first_frame_report(data);
+
+	gstreamer_stats_add(&data->stats, STATS_FRAMES, 1);
+
+	GstClockTime running_time;
+	GstClockTimeDiff latency = sample_latency(data, appsink, sample, &running_time);
+	if (sink->config->qos)
+		video_qos(appsink, buffer, running_time, sample_lateness(appsink, latency));
 
 	gst_buffer_unmap(buffer, &info);
 	gst_sample_unref(sample);
@@ -365,198 +1204,1162 @@ static GstFlowReturn audio_new_sample(GstAppSink *appsink, gpointer user_data)
 	return GST_FLOW_OK;
 }
 
+// audio time stamps follow an exact count of samples from an anchor, so
+// varying buffer sizes can't add up to drift. with pipeline time stamps the
+// anchor is pulled towards them by at most 0.1% of each buffer's duration, so
+// clock drift is corrected without gaps or overlaps. after a discontinuity it
+// is moved in one step.
+static uint64_t audio_timestamp(audio_sink_t *sink, GstAppSink *appsink, GstSample *sample, guint frames)
+{
+	GstClockTime expected = sink->anchor + gst_util_uint64_scale(sink->samples, GST_SECOND, sink->info.rate);
+	GstClockTime timestamp = sink->config->use_timestamps_audio ? sample_timestamp(appsink, sample)
+								    : GST_CLOCK_TIME_NONE;
+
+	if (GST_CLOCK_TIME_IS_VALID(timestamp)) {
+		GstClockTimeDiff drift = GST_CLOCK_DIFF(expected, timestamp);
+
+		if (!sink->anchored || drift > 50 * GST_MSECOND || drift < -50 * GST_MSECOND) {
+			if (sink->anchored)
+				blog(LOG_DEBUG,
+				     "[obs-gstreamer] %s: Audio time stamps off by %" G_GINT64_FORMAT " ms, resyncing",
+				     obs_source_get_name(sink->data->source), drift / GST_MSECOND);
+
+			sink->anchored = true;
+			sink->anchor = timestamp;
+			sink->samples = 0;
+			sink->drift = 0;
+			expected = timestamp;
+		} else {
+			// averaged, the time stamps themselves jitter
+			sink->drift += (drift - sink->drift) / 16;
+
+			GstClockTimeDiff limit = gst_util_uint64_scale(frames, GST_MSECOND, sink->info.rate);
+			GstClockTimeDiff step = CLAMP(sink->drift, -limit, limit);
+
+			sink->anchor += step;
+			expected += step;
+		}
+	}
+
+	sink->samples += frames;
+
+	return expected;
+}
+
+static GstFlowReturn audio_new_sample(GstAppSink *appsink, gpointer user_data)
+{
+	audio_sink_t *sink = user_data;
+	data_t *data = sink->data;
+	GstSample *sample = gst_app_sink_pull_sample(appsink);
+	GstBuffer *buffer = gst_sample_get_buffer(sample);
+	GstCaps *caps = gst_sample_get_caps(sample);
+	GstAudioBuffer info;
+
+	if (!pipeline_is_active(data, sink->generation)) {
+		gst_sample_unref(sample);
+		return GST_FLOW_OK;
+	}
+
+	if (caps != sink->caps)
+		audio_sink_set_caps(sink, caps);
+
+	// one mapping covers all channel planes
+	if (!gst_audio_buffer_map(&info, &sink->info, buffer, GST_MAP_READ)) {
+		gst_sample_unref(sample);
+		return GST_FLOW_OK;
+	}
+
+	struct obs_source_audio *audio = &sink->audio;
+
+	audio->frames = info.n_samples;
+	for (gint i = 0; i < info.n_planes && i < MAX_AV_PLANES; i++)
+		audio->data[i] = info.planes[i];
+
+	audio->timestamp = audio_timestamp(sink, appsink, sample, audio->frames);
+
+	obs_source_output_audio(data->source, audio);
+	media_position_update(data, sample);
+
+	first_frame_report(data);
+
+	gstreamer_stats_add(&data->stats, STATS_SAMPLES, audio->frames);
+
+	GstClockTime running_time;
+	sample_latency(data, appsink, sample, &running_time);
+
+	gst_audio_buffer_unmap(&info);
+	gst_sample_unref(sample);
+
+	return GST_FLOW_OK;
+}
+
 const char *gstreamer_source_get_name(void *type_data)
 {
 	return "GStreamer Source";
 }
 
-enum obs_media_state gstreamer_source_get_state(void *user_data)
+enum obs_media_state gstreamer_source_get_state(void *user_data)
+{
+	data_t *data = user_data;
+	enum obs_media_state state = g_atomic_int_get(&data->obs_media_state);
+
+	if (g_atomic_int_get(&data->buffering) && state != OBS_MEDIA_STATE_ERROR)
+		return OBS_MEDIA_STATE_BUFFERING;
+
+	return state;
+}
+
+int64_t gstreamer_source_get_time(void *user_data)
+{
+	data_t *data = user_data;
+
+	return g_atomic_int_get(&data->position_ms);
+}
+
+int64_t gstreamer_source_get_duration(void *user_data)
+{
+	data_t *data = user_data;
+
+	return MAX(g_atomic_int_get(&data->duration_ms), 0);
+}
+
+static gboolean pipeline_pause(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	if (data->pipe)
+		gst_element_set_state(data->pipe, GST_STATE_PAUSED);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean pipeline_play(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	if (data->pipe)
+		gst_element_set_state(data->pipe, GST_STATE_PLAYING);
+
+	return G_SOURCE_REMOVE;
+}
+
+static GstPadProbeReturn standby_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+	return GST_PAD_PROBE_DROP;
+}
+
+static gulong standby_probe_add(GstElement *pipe, const char *name)
+{
+	GstElement *element = gst_bin_get_by_name(GST_BIN(pipe), name);
+	GstPad *pad = gst_element_get_static_pad(element, "sink");
+
+	gulong id = gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST, standby_probe,
+				      NULL, NULL);
+
+	gst_object_unref(pad);
+	gst_object_unref(element);
+
+	return id;
+}
+
+static void standby_probe_remove(GstElement *pipe, const char *name, gulong id)
+{
+	GstElement *element = gst_bin_get_by_name(GST_BIN(pipe), name);
+	GstPad *pad = gst_element_get_static_pad(element, "sink");
+
+	gst_pad_remove_probe(pad, id);
+
+	gst_object_unref(pad);
+	gst_object_unref(element);
+}
+
+static gboolean pipeline_standby(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	if (data->standby)
+		return G_SOURCE_REMOVE;
+
+	data->standby = true;
+
+	// an update is still in flight, pipeline_resume() starts over with the
+	// current settings instead
+	if (data->pipe_pending)
+		pipeline_destroy(data);
+
+	if (!data->pipe)
+		return G_SOURCE_REMOVE;
+
+	// pausing a live pipeline would drop the connection state we want to
+	// keep warm (e.g. RTSP), so live pipelines keep running and discard
+	// everything in front of the plugin's converters. all others just pause.
+	gboolean live = FALSE;
+	GstQuery *query = gst_query_new_latency();
+	if (gst_element_query(data->pipe, query))
+		gst_query_parse_latency(query, &live, NULL, NULL);
+	gst_query_unref(query);
+
+	if (live) {
+		data->standby_probe_video = standby_probe_add(data->pipe, "video");
+		data->standby_probe_audio = standby_probe_add(data->pipe, "audio");
+	} else {
+		gst_element_set_state(data->pipe, GST_STATE_PAUSED);
+		data->standby_paused = true;
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean pipeline_resume(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	if (!data->standby) {
+		// the pipeline may have been stopped through the media controls
+		if (!data->pipe)
+			return pipeline_restart(data);
+		return G_SOURCE_REMOVE;
+	}
+
+	data->standby = false;
+
+	// a restart was requested while in standby
+	if (!data->pipe)
+		return pipeline_restart(data);
+
+	first_frame_mark(data, FIRST_FRAME_RESUME);
+
+	if (data->standby_paused) {
+		gst_element_set_state(data->pipe, GST_STATE_PLAYING);
+		data->standby_paused = false;
+	}
+
+	if (data->standby_probe_video) {
+		standby_probe_remove(data->pipe, "video", data->standby_probe_video);
+		data->standby_probe_video = 0;
+	}
+
+	if (data->standby_probe_audio) {
+		standby_probe_remove(data->pipe, "audio", data->standby_probe_audio);
+		data->standby_probe_audio = 0;
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+void gstreamer_source_play_pause(void *user_data, bool pause)
+{
+	data_t *data = user_data;
+
+	// stopped, e.g. hidden with stop_on_hide
+	if (data->worker == NULL)
+		return;
+
+	g_main_context_invoke(data->worker->context, pause ? pipeline_pause : pipeline_play, data);
+}
+
+void gstreamer_source_stop(void *user_data)
+{
+	data_t *data = user_data;
+
+	if (data->worker == NULL)
+		return;
+
+	g_main_context_invoke(data->worker->context, pipeline_destroy, data);
+}
+
+void gstreamer_source_restart(void *user_data)
+{
+	data_t *data = user_data;
+
+	if (data->worker == NULL)
+		return;
+
+	g_main_context_invoke(data->worker->context, pipeline_restart, data);
+}
+
+static gboolean pipeline_seek_settle(gpointer user_data);
+
+static void pipeline_seek(data_t *data, gint64 position, bool trick)
+{
+	gboolean seek_enabled;
+
+	// determine whether seeking is possible on this pipeline
+	GstQuery *query;
+	gint64 start, end;
+	query = gst_query_new_seeking(GST_FORMAT_TIME);
+	if (!gst_element_query(data->pipe, query)) {
+		const char *source_name = obs_source_get_name(data->source);
+		blog(LOG_ERROR, "[obs-gstreamer] %s: Seeking query failed", source_name);
+		gst_query_unref(query);
+		return;
+	}
+	gst_query_parse_seeking(query, NULL, &seek_enabled, &start, &end);
+	gst_query_unref(query);
+
+	if (!seek_enabled) {
+		const char *source_name = obs_source_get_name(data->source);
+		blog(LOG_WARNING, "[obs-gstreamer] %s: Seeking is disabled", source_name);
+		return;
+	}
+
+	// keep the segment flag so looping continues
+	GstSeekFlags flags = GST_SEEK_FLAG_FLUSH;
+	if (data->config->loop)
+		flags |= GST_SEEK_FLAG_SEGMENT;
+	if (trick)
+		flags |= GST_SEEK_FLAG_TRICKMODE | GST_SEEK_FLAG_TRICKMODE_KEY_UNITS;
+
+	// with a keyframe index the demuxer does not have to search for one
+	gint64 seek_pos = -1;
+	gpointer index = g_object_get_data(G_OBJECT(data->pipe), "keyframe-index");
+	if (index)
+		seek_pos = gstreamer_keyframe_index_find(index, position);
+	if (seek_pos < 0) {
+		seek_pos = position;
+		flags |= GST_SEEK_FLAG_KEY_UNIT;
+	}
+
+	// do the seek
+	if (!gst_element_seek_simple(data->pipe, GST_FORMAT_TIME, flags, seek_pos))
+		return;
+
+	g_atomic_int_set(&data->position_ms, MIN(GST_TIME_AS_MSECONDS(position), G_MAXINT));
+
+	data->seek_in_flight = true;
+	data->seek_trick = trick;
+	data->seek_time = g_get_monotonic_time();
+	data->seek_last_pos = position;
+
+	if (!trick) {
+		first_frame_mark(data, FIRST_FRAME_SEEK);
+		return;
+	}
+
+	// decode normally again once scrubbing stopped
+	if (data->seek_settle == NULL) {
+		data->seek_settle = g_timeout_source_new(300);
+		g_source_set_callback(data->seek_settle, pipeline_seek_settle, data, seek_settle_destroy);
+		g_source_attach(data->seek_settle, g_main_context_get_thread_default());
+	}
+}
+
+// only the latest requested position is executed, and only once the previous
+// seek completed. requests following each other quickly count as scrubbing,
+// which decodes keyframes only.
+static gboolean pipeline_seek_to_pending(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	g_atomic_int_set(&data->seek_scheduled, 0);
+
+	if (!data->pipe)
+		return G_SOURCE_REMOVE;
+
+	gint64 now = g_get_monotonic_time();
+
+	// ASYNC_DONE picks up the pending position. don't wait forever in case
+	// it never comes.
+	if (data->seek_in_flight && now - data->seek_time < G_USEC_PER_SEC)
+		return G_SOURCE_REMOVE;
+
+	gint ms;
+	do {
+		ms = g_atomic_int_get(&data->seek_pending_ms);
+	} while (ms >= 0 && !g_atomic_int_compare_and_exchange(&data->seek_pending_ms, ms, -1));
+
+	if (ms < 0)
+		return G_SOURCE_REMOVE;
+
+	pipeline_seek(data, ms * GST_MSECOND, now - data->seek_time < 500 * G_TIME_SPAN_MILLISECOND);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean pipeline_seek_settle(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	if (!data->seek_trick)
+		return G_SOURCE_REMOVE;
+
+	if (data->seek_in_flight || g_atomic_int_get(&data->seek_pending_ms) >= 0 ||
+	    g_get_monotonic_time() - data->seek_time < 300 * G_TIME_SPAN_MILLISECOND)
+		return G_SOURCE_CONTINUE;
+
+	pipeline_seek(data, data->seek_last_pos, false);
+
+	return G_SOURCE_REMOVE;
+}
+
+void gstreamer_source_set_time(void *user_data, int64_t ms)
+{
+	data_t *data = user_data;
+
+	if (data->worker == NULL)
+		return;
+
+	g_atomic_int_set(&data->seek_pending_ms, CLAMP(ms, 0, G_MAXINT));
+
+	if (g_atomic_int_compare_and_exchange(&data->seek_scheduled, 0, 1))
+		g_main_context_invoke(data->worker->context, pipeline_seek_to_pending, data);
+}
+
+static void invoke_signal(data_t *data)
+{
+	g_mutex_lock(&data->mutex);
+	data->invoke_done = true;
+	g_cond_signal(&data->cond);
+	g_mutex_unlock(&data->mutex);
+}
+
+static guint64 videorate_dropped(GstElement *pipe)
+{
+	GstElement *rate = video_branch_get(pipe, "video_rate");
+	guint64 dropped = 0;
+
+	if (rate == NULL)
+		return 0;
+
+	// the first element is named "video", whether or not it is the videorate
+	if (g_object_class_find_property(G_OBJECT_GET_CLASS(rate), "drop"))
+		g_object_get(rate, "drop", &dropped, NULL);
+
+	gst_object_unref(rate);
+
+	return dropped;
+}
+
+// collects what is only known to the pipeline and logs the periodic summary,
+// also while the source is stalled
+static gboolean stats_poll(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	if (data->pipe) {
+		guint64 decimated = videorate_dropped(data->pipe);
+
+		gstreamer_stats_add(&data->stats, STATS_DECIMATED, decimated - data->stats_decimated);
+		data->stats_decimated = decimated;
+	}
+
+	gstreamer_stats_fold(&data->stats);
+
+	if (gstreamer_stats_due(&data->stats))
+		gstreamer_stats_log(&data->stats, obs_source_get_name(data->source));
+
+	gpointer profile = data->pipe ? g_object_get_data(G_OBJECT(data->pipe), "profile") : NULL;
+	if (profile && g_get_monotonic_time() - data->profile_time >= 30 * G_USEC_PER_SEC) {
+		gstreamer_profile_report(profile);
+		data->profile_time = g_get_monotonic_time();
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void stats_timeout_destroy(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	g_source_unref(data->stats_timeout);
+	data->stats_timeout = NULL;
+}
+
+static gboolean loop_startup(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	data->stats_timeout = g_timeout_source_new_seconds(1);
+	g_source_set_callback(data->stats_timeout, stats_poll, data, stats_timeout_destroy);
+	g_source_attach(data->stats_timeout, data->worker->context);
+
+	pipeline_start(data);
+
+	if (data->pipe)
+		pipeline_set_playing(data->pipe);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean loop_shutdown_done(gpointer user_data)
+{
+	invoke_signal(user_data);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean loop_shutdown(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	pipeline_destroy(data);
+
+	if (data->timeout)
+		g_source_destroy(data->timeout);
+
+	if (data->stats_timeout)
+		g_source_destroy(data->stats_timeout);
+
+	// streaming threads may have queued work for this source until the
+	// pipelines were gone. let that run before the source can be freed.
+	GSource *source = g_idle_source_new();
+	g_source_set_callback(source, loop_shutdown_done, data, NULL);
+	g_source_attach(source, data->worker->context);
+	g_source_unref(source);
+
+	return G_SOURCE_REMOVE;
+}
+
+// path of the file played by a filesrc or a file:// uri, NULL for anything else
+static gchar *pipeline_file_location(GstElement *pipe)
+{
+	GstIterator *it = gst_bin_iterate_recurse(GST_BIN(pipe));
+	GValue item = G_VALUE_INIT;
+	gchar *location = NULL;
+
+	while (location == NULL && gst_iterator_next(it, &item) == GST_ITERATOR_OK) {
+		GstElement *element = g_value_get_object(&item);
+		GstElementFactory *factory = gst_element_get_factory(element);
+
+		if (factory && g_strcmp0(GST_OBJECT_NAME(factory), "filesrc") == 0) {
+			g_object_get(element, "location", &location, NULL);
+		} else if (g_object_class_find_property(G_OBJECT_GET_CLASS(element), "uri")) {
+			gchar *uri = NULL;
+			g_object_get(element, "uri", &uri, NULL);
+			if (uri && g_str_has_prefix(uri, "file://"))
+				location = g_filename_from_uri(uri, NULL, NULL);
+			g_free(uri);
+		}
+
+		g_value_reset(&item);
+	}
+
+	g_value_unset(&item);
+	gst_iterator_free(it);
+
+	return location;
+}
+
+typedef struct {
+	GstElement *pipe;
+	GstClock *clock;
+	gchar *server;
+	gint64 deadline;
+} ntp_sync_t;
+
+static void ntp_sync_free(gpointer user_data)
+{
+	ntp_sync_t *sync = user_data;
+
+	g_free(sync->server);
+	g_free(sync);
+}
+
+// for timeouts that work on a pipeline and go away with it
+static void pipeline_source_free(gpointer user_data)
+{
+	GSource *source = user_data;
+
+	g_source_destroy(source);
+	g_source_unref(source);
+}
+
+// the shared NTP clock is still syncing. the pipeline runs on the system clock
+// (or waits in PAUSED when gated) and switches over here once it is synced.
+static gboolean ntp_sync_poll(gpointer user_data)
+{
+	ntp_sync_t *sync = user_data;
+	GstElement *pipe = sync->pipe;
+
+	if (!gst_clock_is_synced(sync->clock)) {
+		if (g_get_monotonic_time() < sync->deadline)
+			return G_SOURCE_CONTINUE;
+
+		blog(LOG_ERROR, "Failed to sync to net clock %s, timeout", sync->server);
+	} else {
+		gst_pipeline_use_clock(GST_PIPELINE(pipe), sync->clock);
+	}
+
+	GstState state = GST_STATE_NULL;
+	gst_element_get_state(pipe, NULL, &state, 0);
+
+	if (g_object_get_data(G_OBJECT(pipe), "ntp-sync-gate")) {
+		g_object_set_data(G_OBJECT(pipe), "ntp-sync-gate", NULL);
+
+		if (state == GST_STATE_PAUSED)
+			gst_element_set_state(pipe, GST_STATE_PLAYING);
+	} else if (gst_clock_is_synced(sync->clock) && state == GST_STATE_PLAYING) {
+		// the pipeline only picks a new clock when going to PLAYING
+		gst_element_set_state(pipe, GST_STATE_PAUSED);
+		gst_element_set_state(pipe, GST_STATE_PLAYING);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+typedef struct {
+	data_t *data;
+	gint64 start;
+} convert_timing_t;
+
+static GstPadProbeReturn convert_sink_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+	convert_timing_t *timing = user_data;
+
+	timing->start = g_get_monotonic_time();
+
+	return GST_PAD_PROBE_OK;
+}
+
+// input and output happen on the same streaming thread, whatever the number of
+// threads the conversion itself is split across
+static GstPadProbeReturn convert_src_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+	convert_timing_t *timing = user_data;
+
+	if (timing->start) {
+		gstreamer_stats_add(&timing->data->stats, STATS_CONVERTED, 1);
+		gstreamer_stats_add(&timing->data->stats, STATS_CONVERT_TIME, g_get_monotonic_time() - timing->start);
+		timing->start = 0;
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+// auto thread count, about one thread per megapixel of the incoming video. the
+// converter picks it up when it is configured for the new caps.
+static GstPadProbeReturn convert_caps_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+	data_t *data = user_data;
+	GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+
+	if (GST_EVENT_TYPE(event) != GST_EVENT_CAPS)
+		return GST_PAD_PROBE_OK;
+
+	GstCaps *caps = NULL;
+	gst_event_parse_caps(event, &caps);
+
+	GstVideoInfo video_info;
+	if (!gst_video_info_from_caps(&video_info, caps))
+		return GST_PAD_PROBE_OK;
+
+	guint pixels = video_info.width * video_info.height;
+	guint threads = CLAMP((pixels + 999999) / 1000000, 1, g_get_num_processors());
+
+	GstElement *convert = gst_pad_get_parent_element(pad);
+	g_object_set(convert, "n-threads", threads, NULL);
+	gst_object_unref(convert);
+
+	blog(LOG_INFO, "[obs-gstreamer] %s: converting %dx%d video with %u threads", obs_source_get_name(data->source),
+	     video_info.width, video_info.height, threads);
+
+	return GST_PAD_PROBE_OK;
+}
+
+static void convert_setup(data_t *data, GstElement *pipe)
 {
-	data_t *data = user_data;
+	GstElement *convert = video_branch_get(pipe, "video_convert");
 
-	if (data->buffering && data->obs_media_state != OBS_MEDIA_STATE_ERROR)
-		return OBS_MEDIA_STATE_BUFFERING;
+	convert_timing_t *timing = g_new0(convert_timing_t, 1);
+	timing->data = data;
+	g_object_set_data_full(G_OBJECT(pipe), "convert-timing", timing, g_free);
+
+	GstPad *pad = gst_element_get_static_pad(convert, "sink");
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, convert_sink_probe, timing, NULL);
+	if (obs_data_get_int(data->settings, "convert_threads") == 0)
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, convert_caps_probe, data, NULL);
+	gst_object_unref(pad);
+
+	pad = gst_element_get_static_pad(convert, "src");
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, convert_src_probe, timing, NULL);
+	gst_object_unref(pad);
 
-	return data->obs_media_state;
+	gst_object_unref(convert);
 }
 
-int64_t gstreamer_source_get_time(void *user_data)
+typedef struct {
+	data_t *data;
+	GstElement *pipe;
+	bool started;
+	GstClockTime min_latency;
+	GstClockTime latency;
+	guint stable;
+	guint hold;
+	guint late;
+} latency_control_t;
+
+static void latency_control_apply(latency_control_t *control, guint problems)
 {
-	data_t *data = user_data;
-	int64_t position;
+	data_t *data = control->data;
+	gint latency = control->latency / GST_MSECOND;
 
-	if (!data->pipe)
-		return 0;
+	gst_pipeline_set_latency(GST_PIPELINE(control->pipe), control->latency);
+	g_atomic_int_set(&data->latency_ms, latency);
 
-	if (gst_element_query_position(data->pipe, GST_FORMAT_TIME, &position))
-		if (GST_CLOCK_TIME_IS_VALID(position))
-			return GST_TIME_AS_MSECONDS(position);
+	g_mutex_lock(&data->latency_mutex);
+	latency_step_t *step = &data->latency_history[data->latency_history_count++ % LATENCY_HISTORY];
+	step->time = g_get_real_time() / 1000;
+	step->latency = latency;
+	step->problems = problems;
+	g_mutex_unlock(&data->latency_mutex);
 
-	return 0;
+	blog(LOG_INFO, "[obs-gstreamer] %s: Set latency to %d ms, %u late",
+	     obs_source_get_name(data->source), latency, problems);
 }
 
-int64_t gstreamer_source_get_duration(void *user_data)
+// steps the latency of a live pipeline down while samples arrive in time and
+// backs off quickly when they don't. each back off doubles the time the
+// latency has to be stable before it is lowered again.
+static gboolean latency_control_poll(gpointer user_data)
 {
-	data_t *data = user_data;
-	int64_t duration;
+	latency_control_t *control = user_data;
+	data_t *data = control->data;
 
-	if (!data->pipe)
-		return 0;
+	// only the pipeline feeding OBS is measured
+	if (control->pipe != data->pipe)
+		return G_SOURCE_CONTINUE;
+
+	// late samples are the signal. frames decoders skip on QoS events follow
+	// from them, and the appsinks do not drop anything themselves.
+	guint late = g_atomic_int_get(&data->late_samples);
+	guint problems = late - control->late;
+
+	control->late = late;
+
+	if (!control->started) {
+		GstQuery *query = gst_query_new_latency();
+		gboolean live = FALSE;
+		GstClockTime min_latency = 0;
+
+		bool valid = gst_element_query(control->pipe, query);
+		if (valid)
+			gst_query_parse_latency(query, &live, &min_latency, NULL);
+		gst_query_unref(query);
+
+		if (!valid)
+			return G_SOURCE_CONTINUE;
+
+		if (!live) {
+			blog(LOG_INFO, "[obs-gstreamer] %s: Pipeline is not live, adaptive latency is not used",
+			     obs_source_get_name(data->source));
+			return G_SOURCE_REMOVE;
+		}
+
+		GstClockTime latency = gst_pipeline_get_latency(GST_PIPELINE(control->pipe));
+
+		control->started = true;
+		control->min_latency = min_latency;
+		control->latency = GST_CLOCK_TIME_IS_VALID(latency) ? MAX(latency, min_latency) : min_latency;
+		control->hold = 10;
+
+		latency_control_apply(control, 0);
+
+		return G_SOURCE_CONTINUE;
+	}
+
+	GstClockTime latency = control->latency;
+
+	if (problems > 0) {
+		latency = MIN(latency + MAX(20 * GST_MSECOND, latency / 4), 5 * GST_SECOND);
+		control->hold = MIN(control->hold * 2, 120);
+		control->stable = 0;
+	} else if (++control->stable >= control->hold) {
+		latency = latency > control->min_latency + 10 * GST_MSECOND ? latency - 10 * GST_MSECOND
+									     : control->min_latency;
+		control->stable = 0;
+	}
 
-	if (gst_element_query_duration(data->pipe, GST_FORMAT_TIME, &duration))
-		if (GST_CLOCK_TIME_IS_VALID(duration))
-			return GST_TIME_AS_MSECONDS(duration);
+	if (latency != control->latency) {
+		control->latency = latency;
+		latency_control_apply(control, problems);
+	}
 
-	return 0;
+	return G_SOURCE_CONTINUE;
 }
 
-static gboolean pipeline_pause(gpointer user_data)
+static void latency_control_setup(data_t *data, GstElement *pipe)
 {
-	data_t *data = user_data;
+	if (!obs_data_get_bool(data->settings, "latency_adaptive"))
+		return;
 
-	if (data->pipe)
-		gst_element_set_state(data->pipe, GST_STATE_PAUSED);
+	latency_control_t *control = g_new0(latency_control_t, 1);
+	control->data = data;
+	control->pipe = pipe;
+	control->late = g_atomic_int_get(&data->late_samples);
 
-	return G_SOURCE_REMOVE;
+	GSource *source = g_timeout_source_new_seconds(1);
+	g_source_set_callback(source, latency_control_poll, control, g_free);
+	g_source_attach(source, g_main_context_get_thread_default());
+	g_object_set_data_full(G_OBJECT(pipe), "latency-control", source, pipeline_source_free);
 }
 
-static gboolean pipeline_play(gpointer user_data)
+typedef struct {
+	obs_source_t *source;
+	gint width;
+	gint height;
+	bool cover;
+	bool full_size;
+} render_size_t;
+
+static bool render_size_item(obs_scene_t *scene, obs_sceneitem_t *item, void *param)
 {
-	data_t *data = user_data;
+	render_size_t *size = param;
 
-	if (data->pipe)
-		gst_element_set_state(data->pipe, GST_STATE_PLAYING);
+	if (obs_sceneitem_is_group(item))
+		obs_sceneitem_group_enum_items(item, render_size_item, param);
 
-	return G_SOURCE_REMOVE;
+	if (obs_sceneitem_get_source(item) != size->source)
+		return true;
+
+	// without bounds an item is drawn at the size of the frames times its
+	// scale, smaller frames would shrink it on screen
+	enum obs_bounds_type type = obs_sceneitem_get_bounds_type(item);
+	if (type == OBS_BOUNDS_NONE) {
+		size->full_size = true;
+		return true;
+	}
+
+	// the crop is in pixels of the frames, on smaller frames the same crop
+	// would cut off more of the picture
+	struct obs_sceneitem_crop crop;
+	obs_sceneitem_get_crop(item, &crop);
+	if (crop.left || crop.top || crop.right || crop.bottom) {
+		size->full_size = true;
+		return true;
+	}
+
+	if (type != OBS_BOUNDS_SCALE_INNER)
+		size->cover = true;
+
+	struct vec2 bounds;
+	obs_sceneitem_get_bounds(item, &bounds);
+
+	size->width = MAX(size->width, (gint)bounds.x);
+	size->height = MAX(size->height, (gint)bounds.y);
+
+	return true;
 }
 
-void gstreamer_source_play_pause(void *user_data, bool pause)
+static bool render_size_scene(void *param, obs_source_t *source)
 {
-	data_t *data = user_data;
+	obs_scene_enum_items(obs_scene_from_source(source), render_size_item, param);
 
-	g_main_context_invoke(g_main_loop_get_context(data->loop), pause ? pipeline_pause : pipeline_play, data);
+	return true;
 }
 
-void gstreamer_source_stop(void *user_data)
+typedef struct {
+	data_t *data;
+	GstElement *pipe;
+	bool scene;
+	gint max_width;
+	gint max_height;
+	gint inactive_scale; // percent, 0 for the full size
+	render_size_t size;
+	gint64 size_time;
+	gint width;
+	gint height;
+} scaler_t;
+
+// scales the frames down to the largest size they are drawn at, or the
+// configured maximum. changing the caps of the capsfilter renegotiates the
+// running pipeline.
+static gboolean scaler_poll(gpointer user_data)
 {
-	data_t *data = user_data;
+	scaler_t *scaler = user_data;
+
+	GstElement *scale = video_branch_get(scaler->pipe, "video_scale");
+	GstPad *pad = gst_element_get_static_pad(scale, "sink");
+	GstCaps *caps = gst_pad_get_current_caps(pad);
+	gst_object_unref(pad);
+	gst_object_unref(scale);
+
+	GstVideoInfo info;
+	bool valid = caps && gst_video_info_from_caps(&info, caps);
+	if (caps)
+		gst_caps_unref(caps);
+	if (!valid)
+		return G_SOURCE_CONTINUE;
+
+	double factor = 1.0;
+
+	if (scaler->scene) {
+		// walking all scenes of the collection is not free, changed items
+		// are picked up within a few seconds
+		gint64 now = g_get_monotonic_time();
+		if (now - scaler->size_time >= 3 * G_USEC_PER_SEC) {
+			scaler->size = (render_size_t){scaler->data->source};
+			obs_enum_scenes(render_size_scene, &scaler->size);
+			scaler->size_time = now;
+		}
+
+		render_size_t *size = &scaler->size;
+		if (!size->full_size && size->width > 0 && size->height > 0) {
+			double x = (double)size->width / info.width;
+			double y = (double)size->height / info.height;
+			factor = MIN(factor, size->cover ? MAX(x, y) : MIN(x, y));
+		}
+	}
+	if (scaler->max_width > 0)
+		factor = MIN(factor, (double)scaler->max_width / info.width);
+	if (scaler->max_height > 0)
+		factor = MIN(factor, (double)scaler->max_height / info.height);
+	if (scaler->inactive_scale > 0 && g_atomic_int_get(&scaler->data->inactive))
+		factor = MIN(factor, scaler->inactive_scale / 100.0);
+
+	gint width = MAX(2, (gint)(info.width * factor + 0.5) & ~1);
+	gint height = MAX(2, (gint)(info.height * factor + 0.5) & ~1);
+
+	// keep the original size as is, odd sizes included
+	if (factor >= 1.0 || (width >= info.width && height >= info.height))
+		width = height = 0;
+
+	if (width == scaler->width && height == scaler->height)
+		return G_SOURCE_CONTINUE;
+
+	scaler->width = width;
+	scaler->height = height;
 
-	g_main_context_invoke(g_main_loop_get_context(data->loop), pipeline_destroy, data);
+	if (width)
+		caps = gst_caps_new_simple("video/x-raw", "width", G_TYPE_INT, width, "height", G_TYPE_INT, height,
+					   "pixel-aspect-ratio", GST_TYPE_FRACTION, info.par_n, info.par_d, NULL);
+	else
+		caps = gst_caps_new_any();
+
+	GstElement *capsfilter = gst_bin_get_by_name(GST_BIN(scaler->pipe), "video_scale_caps");
+	g_object_set(capsfilter, "caps", caps, NULL);
+	gst_object_unref(capsfilter);
+	gst_caps_unref(caps);
+
+	blog(LOG_INFO, "[obs-gstreamer] %s: scaling %dx%d video to %dx%d", obs_source_get_name(scaler->data->source),
+	     info.width, info.height, width ? width : info.width, height ? height : info.height);
+
+	return G_SOURCE_CONTINUE;
 }
 
-void gstreamer_source_restart(void *user_data)
+static void scaler_setup(data_t *data, GstElement *pipe)
 {
-	data_t *data = user_data;
+	const char *mode = obs_data_get_string(data->settings, "scale_mode");
+	bool inactive = strcmp(obs_data_get_string(data->settings, "inactive_mode"), "resolution") == 0;
+	if (strlen(mode) == 0 && !inactive)
+		return;
 
-	g_main_context_invoke(g_main_loop_get_context(data->loop), pipeline_restart, data);
+	scaler_t *scaler = g_new0(scaler_t, 1);
+	scaler->data = data;
+	scaler->pipe = pipe;
+	scaler->scene = strcmp(mode, "scene") == 0;
+	scaler->max_width = obs_data_get_int(data->settings, "scale_max_width");
+	scaler->max_height = obs_data_get_int(data->settings, "scale_max_height");
+	scaler->inactive_scale = inactive ? obs_data_get_int(data->settings, "inactive_scale") : 0;
+
+	GSource *source = g_timeout_source_new(500);
+	g_source_set_callback(source, scaler_poll, scaler, g_free);
+	g_source_attach(source, g_main_context_get_thread_default());
+	g_object_set_data_full(G_OBJECT(pipe), "scaler", source, pipeline_source_free);
+	// owned by the timeout, for polling right away on activation
+	g_object_set_data(G_OBJECT(pipe), "scaler-state", scaler);
 }
 
-static gboolean pipeline_seek_to_pending(gpointer user_data)
+// sources that are showing but not on program, e.g. only in the Studio Mode
+// preview or a multiview, do less work until they are activated again
+typedef struct {
+	data_t *data;
+	gint64 interval;
+	gint64 last;
+} throttle_rate_t;
+
+// drops frames at the head of the video branch, before any of the plugin's
+// elements work on them
+static GstPadProbeReturn throttle_rate_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
 {
-	data_t *data = user_data;
-	gint64 seek_pos_pending;
-	gboolean seek_enabled;
+	throttle_rate_t *rate = user_data;
 
-	seek_pos_pending = data->seek_pos_pending;
-	data->seek_pos_pending = -1;
-
-	if (!data->pipe)
-		return G_SOURCE_REMOVE;
+	if (!g_atomic_int_get(&rate->data->inactive))
+		return GST_PAD_PROBE_OK;
 
-	if (seek_pos_pending < 0) {
-		const char *source_name = obs_source_get_name(data->source);
-		blog(LOG_WARNING, "[obs-gstreamer] %s: No seek_pos_pending", source_name);
-		return G_SOURCE_REMOVE;
+	gint64 now = g_get_monotonic_time();
+	if (now - rate->last >= rate->interval) {
+		rate->last = now;
+		return GST_PAD_PROBE_OK;
 	}
 
-	// determine whether seeking is possible on this pipeline
-	GstQuery *query;
-	gint64 start, end;
-	query = gst_query_new_seeking(GST_FORMAT_TIME);
-	if (!gst_element_query(data->pipe, query)) {
-		const char *source_name = obs_source_get_name(data->source);
-		blog(LOG_ERROR, "[obs-gstreamer] %s: Seeking query failed", source_name);
-		gst_query_unref(query);
-		return G_SOURCE_REMOVE;
+	gstreamer_stats_add(&rate->data->stats, STATS_THROTTLED, 1);
+
+	return GST_PAD_PROBE_DROP;
+}
+
+typedef struct {
+	data_t *data;
+	bool skipping;
+	bool requested;
+} throttle_gate_t;
+
+// decoders only get key frames. once active again the delta frames up to the
+// next key frame cannot be decoded, so one is requested from upstream.
+static GstPadProbeReturn throttle_gate_probe(GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+	throttle_gate_t *gate = user_data;
+	GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+	if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+		gate->skipping = false;
+		return GST_PAD_PROBE_OK;
 	}
-	gst_query_parse_seeking(query, NULL, &seek_enabled, &start, &end);
-	gst_query_unref(query);
 
-	if (!seek_enabled) {
-		const char *source_name = obs_source_get_name(data->source);
-		blog(LOG_WARNING, "[obs-gstreamer] %s: Seeking is disabled", source_name);
-		return G_SOURCE_REMOVE;
+	if (g_atomic_int_get(&gate->data->inactive)) {
+		gate->skipping = true;
+		gate->requested = false;
+	} else if (gate->skipping && !gate->requested) {
+		gst_pad_push_event(pad, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+		gate->requested = true;
 	}
 
-	// do the seek
-	gst_element_seek_simple(data->pipe, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT,
-				seek_pos_pending);
+	if (!gate->skipping)
+		return GST_PAD_PROBE_OK;
 
-	return G_SOURCE_REMOVE;
+	gstreamer_stats_add(&gate->data->stats, STATS_THROTTLED, 1);
+
+	return GST_PAD_PROBE_DROP;
 }
 
-void gstreamer_source_set_time(void *user_data, int64_t ms)
+static void throttle_gate_add(GstElement *element, data_t *data)
 {
-	data_t *data = user_data;
+	const gchar *klass = gst_element_class_get_metadata(GST_ELEMENT_GET_CLASS(element), GST_ELEMENT_METADATA_KLASS);
+	if (klass == NULL || !strstr(klass, "Decoder") || !strstr(klass, "Video"))
+		return;
+
+	GstPad *pad = gst_element_get_static_pad(element, "sink");
+	if (pad == NULL)
+		return;
 
-	data->seek_pos_pending = ms * GST_MSECOND;
-	g_main_context_invoke(g_main_loop_get_context(data->loop), pipeline_seek_to_pending, data);
+	throttle_gate_t *gate = g_new0(throttle_gate_t, 1);
+	gate->data = data;
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, throttle_gate_probe, gate, g_free);
+
+	gst_object_unref(pad);
 }
 
-static gboolean loop_startup(gpointer user_data)
+static void throttle_gate_foreach(const GValue *item, gpointer user_data)
 {
-	data_t *data = user_data;
+	throttle_gate_add(g_value_get_object(item), user_data);
+}
 
-	create_pipeline(data);
+// decodebin and friends add their decoders once the stream type is known
+static void throttle_element_added(GstBin *bin, GstBin *sub_bin, GstElement *element, gpointer user_data)
+{
+	throttle_gate_add(element, user_data);
+}
 
-	g_mutex_lock(&data->mutex);
-	g_cond_signal(&data->cond);
-	g_mutex_unlock(&data->mutex);
+static void throttle_setup(data_t *data, GstElement *pipe)
+{
+	const char *mode = obs_data_get_string(data->settings, "inactive_mode");
+
+	if (strcmp(mode, "framerate") == 0) {
+		throttle_rate_t *rate = g_new0(throttle_rate_t, 1);
+		rate->data = data;
+		rate->interval = G_USEC_PER_SEC / MAX(obs_data_get_int(data->settings, "inactive_fps"), 1);
+
+		GstElement *video = gst_bin_get_by_name(GST_BIN(pipe), "video");
+		GstPad *pad = gst_element_get_static_pad(video, "sink");
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, throttle_rate_probe, rate, g_free);
+		gst_object_unref(pad);
+		gst_object_unref(video);
+	} else if (strcmp(mode, "keyframes") == 0) {
+		GstIterator *it = gst_bin_iterate_recurse(GST_BIN(pipe));
+		gst_iterator_foreach(it, throttle_gate_foreach, data);
+		gst_iterator_free(it);
+
+		g_signal_connect(pipe, "deep-element-added", G_CALLBACK(throttle_element_added), data);
+	}
+}
 
-	if (data->pipe)
-		gst_element_set_state(data->pipe, GST_STATE_PLAYING);
+// the frame rate and key frame modes follow the flag with the next buffer
+static gboolean throttle_update(gpointer user_data)
+{
+	data_t *data = user_data;
+
+	if (!data->pipe)
+		return G_SOURCE_REMOVE;
+
+	scaler_t *scaler = g_object_get_data(G_OBJECT(data->pipe), "scaler-state");
+	if (scaler)
+		scaler_poll(scaler);
 
 	return G_SOURCE_REMOVE;
 }
 
-static void create_pipeline(data_t *data)
+static GstElement *create_pipeline(data_t *data)
 {
 	GError *err = NULL;
 
-	data->frame_count = 0;
-	data->audio_count = 0;
-	data->obs_media_state = OBS_MEDIA_STATE_OPENING;
-	data->seek_pos_pending = -1;
-	data->buffering = false;
+	gchar *video = video_branch(data->settings);
+
+	// planar float at the mix rate is what OBS works with internally, so the
+	// samples are resampled once here and passed on as they are
+	struct obs_audio_info oai;
+	gchar *rate = obs_get_audio_info(&oai) ? g_strdup_printf(", rate=%u", oai.samples_per_sec) : g_strdup("");
+
+	// in shared mode the user's pipeline runs once for all sources using it
+	// and feeds these appsrcs
+	bool shared = obs_data_get_bool(data->settings, "shared");
 
 	gchar *pipeline = g_strdup_printf(
-#ifdef GST_VIDEO_FORMAT_I420_10LE
-		"videoconvert name=video ! video/x-raw, format={I420,NV12,BGRA,BGRx,RGBx,RGBA,YUY2,YVYU,UYVY,I420_10LE,P010_10LE,I420_12LE,Y444_12LE} ! appsink name=video_appsink "
-#else
-		"videoconvert name=video ! video/x-raw, format={I420,NV12,BGRA,BGRx,RGBx,RGBA,YUY2,YVYU,UYVY} ! appsink name=video_appsink "
-#endif
-		"audioconvert name=audio ! audioresample ! audio/x-raw, format={U8,S16LE,S32LE,F32LE}, channels={1,2,3,4,5,6,8}, layout=interleaved ! appsink name=audio_appsink "
+		"%s"
+		"audioconvert name=audio ! audioresample ! audio/x-raw, format=F32LE%s, channels={1,2,3,4,5,6,8}, layout=non-interleaved ! appsink name=audio_appsink "
 		"%s",
-		obs_data_get_string(data->settings, "pipeline"));
+		video, rate,
+		shared ? "appsrc name=shared_video format=time is-live=true ! video. "
+			 "appsrc name=shared_audio format=time is-live=true ! audio."
+		       : obs_data_get_string(data->settings, "pipeline"));
 
-	data->pipe = gst_parse_launch(pipeline, &err);
+	GstElement *pipe = gst_parse_launch(pipeline, &err);
 	g_free(pipeline);
+	g_free(rate);
+	g_free(video);
 	if (err != NULL) {
 		const char *source_name = obs_source_get_name(data->source);
 		blog(LOG_ERROR, "[obs-gstreamer] %s: Cannot start pipeline: %s", source_name, err->message);
 		g_error_free(err);
 
-		data->obs_media_state = OBS_MEDIA_STATE_ERROR;
+		if (pipe)
+			gst_object_unref(pipe);
 
-		obs_source_output_video(data->source, NULL);
+		return NULL;
+	}
 
-		return;
+	if (shared) {
+		GstElement *shared_video = gst_bin_get_by_name(GST_BIN(pipe), "shared_video");
+		GstElement *shared_audio = gst_bin_get_by_name(GST_BIN(pipe), "shared_audio");
+
+		gpointer consumer = gstreamer_shared_attach(obs_data_get_string(data->settings, "pipeline"),
+							    shared_video, shared_audio,
+							    obs_source_get_name(data->source));
+
+		gst_object_unref(shared_video);
+		gst_object_unref(shared_audio);
+
+		if (consumer == NULL) {
+			gst_object_unref(pipe);
+			return NULL;
+		}
+
+		g_object_set_data_full(G_OBJECT(pipe), "shared", consumer, gstreamer_shared_detach);
 	}
 
+	// the snapshot lives as long as the pipeline whose appsinks read it
+	config_t *config = config_new(data->settings);
+	g_object_set_data_full(G_OBJECT(pipe), "config", config, g_free);
+
+	data->generation++;
+
 	GstAppSinkCallbacks video_cbs = {NULL, NULL, video_new_sample};
 
-	GstElement *appsink = gst_bin_get_by_name(GST_BIN(data->pipe), "video_appsink");
-	gst_app_sink_set_callbacks(GST_APP_SINK(appsink), &video_cbs, data, NULL);
+	video_sink_t *video_sink = g_new0(video_sink_t, 1);
+	video_sink->data = data;
+	video_sink->config = config;
+	video_sink->generation = data->generation;
+
+	GstElement *appsink = gst_bin_get_by_name(GST_BIN(pipe), "video_appsink");
+	gst_app_sink_set_callbacks(GST_APP_SINK(appsink), &video_cbs, video_sink, video_sink_free);
 
 	if (!obs_data_get_bool(data->settings, "sync_appsink_video"))
 		g_object_set(appsink, "sync", FALSE, NULL);
@@ -571,10 +2374,10 @@ static void create_pipeline(data_t *data)
 		gst_app_sink_set_drop(GST_APP_SINK(appsink), TRUE);
 
 	// check if connected and remove if not
-	GstElement *sink = gst_bin_get_by_name(GST_BIN(data->pipe), "video");
+	GstElement *sink = gst_bin_get_by_name(GST_BIN(pipe), "video");
 	GstPad *pad = gst_element_get_static_pad(sink, "sink");
 	if (!gst_pad_is_linked(pad))
-		gst_bin_remove(GST_BIN(data->pipe), appsink);
+		gst_bin_remove(GST_BIN(pipe), appsink);
 	gst_object_unref(pad);
 	gst_object_unref(sink);
 
@@ -582,8 +2385,13 @@ static void create_pipeline(data_t *data)
 
 	GstAppSinkCallbacks audio_cbs = {NULL, NULL, audio_new_sample};
 
-	appsink = gst_bin_get_by_name(GST_BIN(data->pipe), "audio_appsink");
-	gst_app_sink_set_callbacks(GST_APP_SINK(appsink), &audio_cbs, data, NULL);
+	audio_sink_t *audio_sink = g_new0(audio_sink_t, 1);
+	audio_sink->data = data;
+	audio_sink->config = config;
+	audio_sink->generation = data->generation;
+
+	appsink = gst_bin_get_by_name(GST_BIN(pipe), "audio_appsink");
+	gst_app_sink_set_callbacks(GST_APP_SINK(appsink), &audio_cbs, audio_sink, audio_sink_free);
 
 	if (!obs_data_get_bool(data->settings, "sync_appsink_audio"))
 		g_object_set(appsink, "sync", FALSE, NULL);
@@ -598,79 +2406,169 @@ static void create_pipeline(data_t *data)
 		gst_app_sink_set_drop(GST_APP_SINK(appsink), TRUE);
 
 	// check if connected and remove if not
-	sink = gst_bin_get_by_name(GST_BIN(data->pipe), "audio");
+	sink = gst_bin_get_by_name(GST_BIN(pipe), "audio");
 	pad = gst_element_get_static_pad(sink, "sink");
 	if (!gst_pad_is_linked(pad))
-		gst_bin_remove(GST_BIN(data->pipe), appsink);
+		gst_bin_remove(GST_BIN(pipe), appsink);
 	gst_object_unref(pad);
 	gst_object_unref(sink);
 
 	gst_object_unref(appsink);
 
-	GstBus *bus = gst_element_get_bus(data->pipe);
+	GstBus *bus = gst_element_get_bus(pipe);
 	gst_bus_add_watch(bus, bus_callback, data);
 	gst_object_unref(bus);
 
-	// set clock
+	convert_setup(data, pipe);
+	scaler_setup(data, pipe);
+	throttle_setup(data, pipe);
+
+	// also covers the elements the plugin adds around the user's pipeline
+	const char *profile_mode = obs_data_get_string(data->settings, "profile");
+	if (strlen(profile_mode) > 0) {
+		gpointer profile = gstreamer_profile_new(pipe, obs_source_get_name(data->source), profile_mode);
+		g_object_set_data_full(G_OBJECT(pipe), "profile", profile, gstreamer_profile_free);
+		data->profile_time = g_get_monotonic_time();
+	}
+
+	if (obs_data_get_bool(data->settings, "keyframe_index")) {
+		gchar *location = pipeline_file_location(pipe);
+		gpointer index = location ? gstreamer_keyframe_index_new(location) : NULL;
+		if (index)
+			g_object_set_data_full(G_OBJECT(pipe), "keyframe-index", index,
+					       gstreamer_keyframe_index_release);
+		g_free(location);
+	}
+
+	if (config->obs_clock) {
+		GstClock *clock = gstreamer_obs_clock_get();
+		gst_pipeline_use_clock(GST_PIPELINE(pipe), clock);
+		gst_object_unref(clock);
+	}
+
+	// the shared pipeline runs on the system clock, which the time stamps
+	// handed to the appsrcs are relative to
 	const char *server = obs_data_get_string(data->settings, "ntp_server");
+	if (shared && (strlen(server) > 0 || strcmp(obs_data_get_string(data->settings, "clock"), "obs") == 0)) {
+		blog(LOG_WARNING, "[obs-gstreamer] %s: Clock settings are ignored for shared pipelines",
+		     obs_source_get_name(data->source));
+		server = "";
+	}
+
+	// set clock
 	if (strlen(server) > 0) {
 		gint clock_port = obs_data_get_int(data->settings, "ntp_port");
-		data->clock = gst_ntp_clock_new("net_clock", server, clock_port, 0);
-		blog(LOG_INFO, "Connect to NTP server %s", server);
-		if (data->clock == NULL) {
+		GstClock *clock = gstreamer_ntp_clock_acquire(server, clock_port);
+		if (clock == NULL) {
 			blog(LOG_ERROR, "Failed to connect to net clock %s", server);
-			return;
+			return pipe;
 		}
-		if (!gst_clock_wait_for_sync(data->clock, 5 * GST_SECOND)) {
-			blog(LOG_ERROR, "Failed to sync to net clock %s, timeout", server);
-			return;
+		// the clock stays shared until the last pipeline using it is gone
+		g_object_set_data_full(G_OBJECT(pipe), "ntp-clock", clock, gstreamer_ntp_clock_release);
+
+		if (gst_clock_is_synced(clock)) {
+			gst_pipeline_use_clock(GST_PIPELINE(pipe), clock);
+		} else {
+			ntp_sync_t *sync = g_new0(ntp_sync_t, 1);
+			sync->pipe = pipe;
+			sync->clock = clock;
+			sync->server = g_strdup(server);
+			sync->deadline = g_get_monotonic_time() + 5 * G_USEC_PER_SEC;
+
+			if (obs_data_get_bool(data->settings, "ntp_wait_sync"))
+				g_object_set_data(G_OBJECT(pipe), "ntp-sync-gate", GINT_TO_POINTER(1));
+
+			GSource *source = g_timeout_source_new(100);
+			g_source_set_callback(source, ntp_sync_poll, sync, ntp_sync_free);
+			g_source_attach(source, g_main_context_get_thread_default());
+			g_object_set_data_full(G_OBJECT(pipe), "ntp-sync", source, pipeline_source_free);
 		}
-		gst_pipeline_use_clock(GST_PIPELINE(data->pipe), GST_CLOCK(data->clock));
 	}
 	gint latency = obs_data_get_int(data->settings, "latency");
 	// set latency
 	if (latency) {
-		gst_pipeline_set_latency(GST_PIPELINE(data->pipe), latency * GST_MSECOND);
-		gint cur_latency = gst_pipeline_get_latency(GST_PIPELINE(data->pipe)) / GST_MSECOND;
+		gst_pipeline_set_latency(GST_PIPELINE(pipe), latency * GST_MSECOND);
+		gint cur_latency = gst_pipeline_get_latency(GST_PIPELINE(pipe)) / GST_MSECOND;
 		blog(LOG_INFO, "Set latency for pipeline to %dms", cur_latency);
+		g_atomic_int_set(&data->latency_ms, cur_latency);
 	}
+
+	// starts from the fixed latency, if any
+	latency_control_setup(data, pipe);
+
+	return pipe;
 }
 
-static gpointer _start(gpointer user_data)
+// run func on the source's worker and wait until it signals completion
+static void invoke_sync(data_t *data, GSourceFunc func)
 {
-	data_t *data = user_data;
-
-	GMainContext *context = g_main_context_new();
+	g_mutex_lock(&data->mutex);
 
-	g_main_context_push_thread_default(context);
+	data->invoke_done = false;
+	g_main_context_invoke(data->worker->context, func, data);
 
-	data->loop = g_main_loop_new(context, FALSE);
+	while (!data->invoke_done)
+		g_cond_wait(&data->cond, &data->mutex);
 
-	GSource *source = g_idle_source_new();
-	g_source_set_callback(source, loop_startup, data, NULL);
-	g_source_attach(source, context);
+	g_mutex_unlock(&data->mutex);
+}
 
-	g_main_loop_run(data->loop);
+// returns right away, the pipeline is built on the worker. a worker builds one
+// pipeline at a time, so startups run at most one per core. later invokes for
+// this source, including stop(), are queued behind it.
+static void start(data_t *data)
+{
+	first_frame_mark(data, FIRST_FRAME_START);
 
-	if (data->pipe)
-		pipeline_destroy(data);
+	g_atomic_int_set(&data->obs_media_state, OBS_MEDIA_STATE_OPENING);
+	data->worker = worker_acquire();
 
-	g_main_loop_unref(data->loop);
-	data->loop = NULL;
+	g_main_context_invoke(data->worker->context, loop_startup, data);
+}
 
-	g_main_context_unref(context);
+static void proc_get_stats(void *user_data, calldata_t *cd)
+{
+	data_t *data = user_data;
 
-	return NULL;
+	gstreamer_stats_get(&data->stats, cd);
 }
 
-static void start(data_t *data)
+// the current pipeline latency and the last adjustments of the adaptive
+// latency as JSON in the "latency" parameter
+static void proc_get_latency(void *user_data, calldata_t *cd)
 {
-	g_mutex_lock(&data->mutex);
+	data_t *data = user_data;
 
-	data->thread = g_thread_new("GStreamer Source", _start, data);
+	obs_data_t *obj = obs_data_create();
 
-	g_cond_wait(&data->cond, &data->mutex);
-	g_mutex_unlock(&data->mutex);
+	obs_data_set_int(obj, "latency_ms", g_atomic_int_get(&data->latency_ms));
+
+	obs_data_array_t *array = obs_data_array_create();
+
+	g_mutex_lock(&data->latency_mutex);
+
+	guint count = MIN(data->latency_history_count, LATENCY_HISTORY);
+
+	for (guint i = data->latency_history_count - count; i < data->latency_history_count; i++) {
+		latency_step_t *step = &data->latency_history[i % LATENCY_HISTORY];
+		obs_data_t *item = obs_data_create();
+
+		obs_data_set_int(item, "time", step->time);
+		obs_data_set_int(item, "latency_ms", step->latency);
+		obs_data_set_int(item, "problems", step->problems);
+
+		obs_data_array_push_back(array, item);
+		obs_data_release(item);
+	}
+
+	g_mutex_unlock(&data->latency_mutex);
+
+	obs_data_set_array(obj, "history", array);
+	obs_data_array_release(array);
+
+	calldata_set_string(cd, "latency", obs_data_get_json(obj));
+
+	obs_data_release(obj);
 }
 
 void *gstreamer_source_create(obs_data_t *settings, obs_source_t *source)
@@ -686,6 +2584,18 @@ void *gstreamer_source_create(obs_data_t *settings, obs_source_t *source)
 	g_mutex_init(&data->mutex);
 	g_cond_init(&data->cond);
 
+	gstreamer_stats_init(&data->stats);
+
+	// -1 for the latency the pipeline picks itself
+	data->latency_ms = -1;
+	g_mutex_init(&data->latency_mutex);
+
+	data->inactive = !obs_source_active(source);
+
+	proc_handler_t *ph = obs_source_get_proc_handler(source);
+	proc_handler_add(ph, "void get_stats(out string stats)", proc_get_stats, data);
+	proc_handler_add(ph, "void get_latency(out string latency)", proc_get_latency, data);
+
 	if (obs_data_get_bool(settings, "stop_on_hide") == false)
 		start(data);
 
@@ -694,13 +2604,15 @@ void *gstreamer_source_create(obs_data_t *settings, obs_source_t *source)
 
 static void stop(data_t *data)
 {
-	if (data->thread == NULL)
+	if (data->worker == NULL)
 		return;
 
-	g_main_loop_quit(data->loop);
+	invoke_sync(data, loop_shutdown);
 
-	g_thread_join(data->thread);
-	data->thread = NULL;
+	worker_release(data->worker);
+	data->worker = NULL;
+
+	data->standby = false;
 
 	obs_source_output_video(data->source, NULL);
 }
@@ -714,6 +2626,10 @@ void gstreamer_source_destroy(void *user_data)
 	g_mutex_clear(&data->mutex);
 	g_cond_clear(&data->cond);
 
+	gstreamer_stats_clear(&data->stats);
+
+	g_mutex_clear(&data->latency_mutex);
+
 	g_free(data);
 }
 
@@ -731,17 +2647,37 @@ void gstreamer_source_get_defaults(obs_data_t *settings)
 	obs_data_set_default_bool(settings, "disable_async_appsink_audio", false);
 	obs_data_set_default_bool(settings, "restart_on_eos", true);
 	obs_data_set_default_bool(settings, "restart_on_error", false);
+	obs_data_set_default_bool(settings, "loop", false);
+	obs_data_set_default_bool(settings, "keyframe_index", false);
+	obs_data_set_default_string(settings, "profile", "");
+	obs_data_set_default_int(settings, "convert_threads", 0);
+	obs_data_set_default_string(settings, "convert_quality", "");
+	obs_data_set_default_bool(settings, "shared", false);
+	obs_data_set_default_bool(settings, "qos", false);
+	obs_data_set_default_bool(settings, "skip_unchanged", false);
+	obs_data_set_default_int(settings, "keepalive_interval", 1000);
+	obs_data_set_default_bool(settings, "limit_fps", false);
+	obs_data_set_default_string(settings, "scale_mode", "");
+	obs_data_set_default_int(settings, "scale_max_width", 0);
+	obs_data_set_default_int(settings, "scale_max_height", 0);
 	obs_data_set_default_int(settings, "restart_timeout", 2000);
 	obs_data_set_default_bool(settings, "no_buffer", false);
 	obs_data_set_default_int(settings, "latency", 0);
+	obs_data_set_default_bool(settings, "latency_adaptive", false);
+	obs_data_set_default_string(settings, "clock", "");
 	obs_data_set_default_string(settings, "ntp_server", "");
 	obs_data_set_default_int(settings, "ntp_port", 123);
+	obs_data_set_default_bool(settings, "ntp_wait_sync", false);
 	obs_data_set_default_bool(settings, "stop_on_hide", true);
+	obs_data_set_default_bool(settings, "standby_on_hide", false);
 	obs_data_set_default_bool(settings, "block_video", false);
 	obs_data_set_default_bool(settings, "block_audio", false);
 	obs_data_set_default_bool(settings, "drop_video", false);
 	obs_data_set_default_bool(settings, "drop_audio", false);
 	obs_data_set_default_bool(settings, "clear_on_end", true);
+	obs_data_set_default_string(settings, "inactive_mode", "");
+	obs_data_set_default_int(settings, "inactive_fps", 5);
+	obs_data_set_default_int(settings, "inactive_scale", 50);
 }
 
 void gstreamer_source_update(void *data, obs_data_t *settings);
@@ -772,7 +2708,19 @@ obs_properties_t *gstreamer_source_get_properties(void *data)
 	obs_properties_add_bool(props, "restart_on_eos", "Try to restart when end of stream is reached");
 	obs_properties_add_bool(props, "restart_on_error", "Try to restart after pipeline encountered an error");
 	obs_properties_add_int(props, "restart_timeout", "Error timeout (ms)", 0, 10000, 100);
+	prop = obs_properties_add_bool(props, "loop", "Loop seamlessly");
+	obs_property_set_long_description(
+		prop,
+		"Seeks back to the start at the end of the media instead of restarting the pipeline.\nOnly works with seekable pipelines, e.g. playing a file.");
+	prop = obs_properties_add_bool(props, "keyframe_index", "Cache keyframe index for seeking");
+	obs_property_set_long_description(
+		prop,
+		"Indexes the keyframes of a played file in the background and caches the index on disk.\nSeeks then go straight to the nearest keyframe. Only used with filesrc or file:// uris.");
 	obs_properties_add_bool(props, "stop_on_hide", "Stop pipeline when hidden");
+	prop = obs_properties_add_bool(props, "standby_on_hide", "Keep pipeline in standby instead of stopping");
+	obs_property_set_long_description(
+		prop,
+		"Only used with \"Stop pipeline when hidden\".\nLive pipelines keep running and their output is discarded while hidden, other pipelines are paused.\nThis avoids reconnecting and prerolling when the source is shown again.");
 	obs_properties_add_bool(props, "clear_on_end", "Clear image data after end-of-stream or error");
 	obs_properties_add_bool(props, "block_video", "Disable video sink buffer");
 	obs_properties_add_bool(props, "drop_video", "Drop video when sink is not fast enough");
@@ -783,40 +2731,151 @@ obs_properties_t *gstreamer_source_get_properties(void *data)
 	obs_property_set_long_description(
 		prop,
 		"This sets a fixed latency for the pipeline for syncing different inputs.\nCheck the error log for clock errors if the set latency is too low.\nSetting 0 auto-detects lowest possible latency for the given pipeline.");
+	prop = obs_properties_add_bool(props, "latency_adaptive", "Adapt latency");
+	obs_property_set_long_description(
+		prop,
+		"Lowers the latency of live pipelines while samples arrive in time and raises it when they are late.\nStarts from the fixed latency if one is set. Only has an effect with appsinks synced to the clock.");
+	prop = obs_properties_add_list(props, "clock", "Clock", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(prop, "Pipeline default", "");
+	obs_property_list_add_string(prop, "OBS clock", "obs");
+	obs_property_set_long_description(
+		prop,
+		"Runs the pipeline on the clock OBS uses, so pipeline time stamps need no offset or drift correction in OBS.\nNot used when a NTP server is set.");
 	prop = obs_properties_add_text(props, "ntp_server", "NTP server", OBS_TEXT_DEFAULT);
 	obs_property_set_long_description(
 		prop,
 		"This sets a NTP server for syncing the gstreamer clock to.\nUse e.g. with rtspsrc rfc7273-sync or ntp-sync options.\nLeave empty to not use a NTP server.");
 	obs_properties_add_int(props, "ntp_port", "NTP server port", 1, 65536, 1);
+	prop = obs_properties_add_bool(props, "ntp_wait_sync", "Wait for NTP sync before playing");
+	obs_property_set_long_description(
+		prop,
+		"Otherwise the pipeline starts on the system clock and switches to the NTP clock once it is synced.\nThe pipeline starts anyway if the clock does not sync within 5 seconds.");
+	prop = obs_properties_add_list(props, "profile", "Profile element latency", OBS_COMBO_TYPE_LIST,
+				       OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(prop, "Off", "");
+	obs_property_list_add_string(prop, "Report to log", "log");
+	obs_property_list_add_string(prop, "Report to JSON file", "json");
+	obs_property_set_long_description(
+		prop,
+		"Measures how long buffers spend in each element of the pipeline.\nThe report is written every 30 seconds and when the pipeline stops, JSON files go to the plugin's config directory.");
+	prop = obs_properties_add_int(props, "convert_threads", "Video conversion threads", 0, 64, 1);
+	obs_property_set_long_description(
+		prop,
+		"Threads for converting the video to a format OBS accepts.\n0 picks them from the resolution and the number of CPU cores.");
+	prop = obs_properties_add_list(props, "convert_quality", "Video conversion quality", OBS_COMBO_TYPE_LIST,
+				       OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(prop, "Default", "");
+	obs_property_list_add_string(prop, "Fast", "fast");
+	obs_property_list_add_string(prop, "High", "high");
+	obs_property_set_long_description(
+		prop,
+		"Dithering and chroma resampling of the video conversion.\nFast skips dithering and uses linear chroma resampling, High uses error diffusion dithering and sinc resampling.");
+	prop = obs_properties_add_bool(props, "shared", "Share pipeline with other sources");
+	obs_property_set_long_description(
+		prop,
+		"Sources with this option and the same pipeline run it only once, e.g. to open a camera stream once for several scenes.\nEach source still converts the video and controls its own playback. The shared pipeline stops with the last source using it. It runs on the system clock, the clock and NTP settings do not apply.");
+	prop = obs_properties_add_bool(props, "qos", "Let decoders skip frames when video is late");
+	obs_property_set_long_description(
+		prop,
+		"Sends QoS events upstream when frames reach OBS too late to be shown in time, so decoders can skip frames to catch up.");
+	prop = obs_properties_add_bool(props, "skip_unchanged", "Skip unchanged frames");
+	obs_property_set_long_description(
+		prop,
+		"Frames identical to the last one are not handed to OBS, e.g. for slides or paused feeds.\nA frame is still handed over every keep-alive interval.");
+	obs_properties_add_int(props, "keepalive_interval", "Keep-alive interval (ms)", 100, 60000, 100);
+	prop = obs_properties_add_bool(props, "limit_fps", "Limit to canvas frame rate");
+	obs_property_set_long_description(
+		prop,
+		"Drops frames above the OBS frame rate before the video is converted, keeping the frame closest to each OBS frame.");
+	prop = obs_properties_add_list(props, "scale_mode", "Scale video down", OBS_COMBO_TYPE_LIST,
+				       OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(prop, "Off", "");
+	obs_property_list_add_string(prop, "To the size of the scene items", "scene");
+	obs_property_list_add_string(prop, "To the maximum size", "max");
+	obs_property_set_long_description(
+		prop,
+		"Scales the video down in the pipeline before it is converted and handed to OBS, and follows resizing without restarting.\nThe size of scene items is only known for items with a bounding box and no crop, others keep the full size.\nThe maximum size applies in both modes.");
+	obs_properties_add_int(props, "scale_max_width", "Maximum width (0 = unlimited)", 0, 16384, 1);
+	obs_properties_add_int(props, "scale_max_height", "Maximum height (0 = unlimited)", 0, 16384, 1);
+	prop = obs_properties_add_list(props, "inactive_mode", "When not on program", OBS_COMBO_TYPE_LIST,
+				       OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(prop, "Full rate", "");
+	obs_property_list_add_string(prop, "Lower frame rate", "framerate");
+	obs_property_list_add_string(prop, "Lower resolution", "resolution");
+	obs_property_list_add_string(prop, "Key frames only", "keyframes");
+	obs_property_set_long_description(
+		prop,
+		"Reduces the work for a source that is showing but not on program, e.g. only in the Studio Mode preview or a multiview.\nLower frame rate drops frames before they are converted, lower resolution scales them down before the conversion. Both return to full rate with the next frame once the source goes on program.\nKey frames only keeps the decoders from decoding anything else. After going on program the video waits for the next key frame, which is requested from upstream.");
+	obs_properties_add_int(props, "inactive_fps", "Frame rate when not on program", 1, 60, 1);
+	obs_properties_add_int_slider(props, "inactive_scale", "Resolution when not on program (%)", 10, 100, 5);
 	obs_properties_add_button2(props, "apply", "Apply", on_apply_clicked, data);
 
 	return props;
 }
 
-void gstreamer_source_update(void *data, obs_data_t *settings)
+void gstreamer_source_update(void *user_data, obs_data_t *settings)
 {
-	stop(data);
+	data_t *data = user_data;
 
 	bool nobuf = obs_data_get_bool(settings, "no_buffer");
-	obs_source_set_async_unbuffered(((data_t *)data)->source, nobuf);
+	obs_source_set_async_unbuffered(data->source, nobuf);
 
 	// Don't start the pipeline if source is hidden and 'stop_on_hide' is set.
 	// From GUI this is probably irrelevant but works around some quirks when
 	// controlled from script.
-	if (obs_data_get_bool(settings, "stop_on_hide") && !obs_source_showing(((data_t *)data)->source))
+	if (obs_data_get_bool(settings, "stop_on_hide") && !obs_source_showing(data->source)) {
+		stop(data);
+		return;
+	}
+
+	// the running pipeline keeps feeding OBS until the new one takes over
+	if (data->worker != NULL) {
+		g_main_context_invoke(data->worker->context, pipeline_prepare, data);
 		return;
+	}
 
 	start(data);
 }
 
-void gstreamer_source_show(void *data)
+void gstreamer_source_show(void *user_data)
 {
-	if (((data_t *)data)->pipe == NULL)
+	data_t *data = user_data;
+
+	if (data->worker == NULL)
 		start(data);
+	else
+		g_main_context_invoke(data->worker->context, pipeline_resume, data);
 }
 
-void gstreamer_source_hide(void *data)
+void gstreamer_source_activate(void *user_data)
 {
-	if (obs_data_get_bool(((data_t *)data)->settings, "stop_on_hide"))
+	data_t *data = user_data;
+
+	g_atomic_int_set(&data->inactive, false);
+
+	if (data->worker != NULL)
+		g_main_context_invoke(data->worker->context, throttle_update, data);
+}
+
+void gstreamer_source_deactivate(void *user_data)
+{
+	data_t *data = user_data;
+
+	g_atomic_int_set(&data->inactive, true);
+
+	if (data->worker != NULL)
+		g_main_context_invoke(data->worker->context, throttle_update, data);
+}
+
+void gstreamer_source_hide(void *user_data)
+{
+	data_t *data = user_data;
+
+	if (!obs_data_get_bool(data->settings, "stop_on_hide"))
+		return;
+
+	if (obs_data_get_bool(data->settings, "standby_on_hide") && data->worker != NULL)
+		g_main_context_invoke(data->worker->context, pipeline_standby, data);
+	else
 		stop(data);
 }
@@ -0,0 +1,220 @@
+/*
+ * obs-gstreamer. OBS Studio plugin.
+ * Copyright (C) 2018-2021 Florian Zwoch <fzwoch@gmail.com>
+ *
+ * This file is part of obs-gstreamer.
+ *
+ * obs-gstreamer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * obs-gstreamer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obs-gstreamer. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gstreamer-stats.h"
+
+// seconds between log summaries, OBS_GSTREAMER_STATS_INTERVAL=0 disables them
+static gint stats_log_interval(void)
+{
+	static gint interval = -1;
+
+	if (g_atomic_int_get(&interval) < 0) {
+		const gchar *env = g_getenv("OBS_GSTREAMER_STATS_INTERVAL");
+		g_atomic_int_set(&interval, env != NULL ? (gint)g_ascii_strtoull(env, NULL, 10) : 60);
+	}
+
+	return g_atomic_int_get(&interval);
+}
+
+void gstreamer_stats_init(gstreamer_stats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	stats->queue_depth = -1;
+	stats->log_time = g_get_monotonic_time() / G_USEC_PER_SEC;
+	stats->bitrate_time = g_get_monotonic_time();
+
+	g_mutex_init(&stats->mutex);
+}
+
+void gstreamer_stats_clear(gstreamer_stats_t *stats)
+{
+	g_mutex_clear(&stats->mutex);
+}
+
+void gstreamer_stats_latency(gstreamer_stats_t *stats, GstClockTimeDiff latency)
+{
+	if (latency < 0)
+		return;
+
+	guint64 ms = latency / GST_MSECOND;
+	guint bucket = 0;
+
+	while (ms > 0 && bucket < STATS_LATENCY_BUCKETS - 1) {
+		ms >>= 1;
+		bucket++;
+	}
+
+	g_atomic_int_inc((gint *)&stats->latency[bucket]);
+}
+
+// whether the next log summary is due, true for only one caller per interval
+bool gstreamer_stats_due(gstreamer_stats_t *stats)
+{
+	gint interval = stats_log_interval();
+	if (interval == 0)
+		return false;
+
+	gint now = g_get_monotonic_time() / G_USEC_PER_SEC;
+	gint last = g_atomic_int_get(&stats->log_time);
+
+	return now - last >= interval && g_atomic_int_compare_and_exchange(&stats->log_time, last, now);
+}
+
+// call with the mutex held
+static void stats_fold(gstreamer_stats_t *stats)
+{
+	for (int i = 0; i < STATS_COUNTERS; i++) {
+		guint value = g_atomic_int_get((gint *)&stats->counters[i]);
+
+		stats->totals[i] += (guint)(value - stats->folded[i]);
+		stats->folded[i] = value;
+	}
+
+	gint64 now = g_get_monotonic_time();
+
+	if (now - stats->bitrate_time >= G_USEC_PER_SEC) {
+		stats->bitrate = (stats->totals[STATS_BYTES] - stats->bitrate_bytes) * 8 * G_USEC_PER_SEC /
+				 (now - stats->bitrate_time);
+		stats->bitrate_bytes = stats->totals[STATS_BYTES];
+		stats->bitrate_time = now;
+	}
+}
+
+// keeps counters that grow fast, like the conversion time, from wrapping twice
+// between two reads
+void gstreamer_stats_fold(gstreamer_stats_t *stats)
+{
+	g_mutex_lock(&stats->mutex);
+	stats_fold(stats);
+	g_mutex_unlock(&stats->mutex);
+}
+
+// upper bound in ms of the bucket holding the given percentile, -1 for none
+static gint stats_latency_percentile(const guint *latency, double percentile)
+{
+	guint64 count = 0;
+
+	for (int i = 0; i < STATS_LATENCY_BUCKETS; i++)
+		count += latency[i];
+
+	if (count == 0)
+		return -1;
+
+	guint64 sum = 0;
+
+	for (int i = 0; i < STATS_LATENCY_BUCKETS; i++) {
+		sum += latency[i];
+		if (sum >= count * percentile)
+			return 1 << i;
+	}
+
+	return 1 << (STATS_LATENCY_BUCKETS - 1);
+}
+
+void gstreamer_stats_log(gstreamer_stats_t *stats, const char *name)
+{
+	guint latency[STATS_LATENCY_BUCKETS];
+
+	for (int i = 0; i < STATS_LATENCY_BUCKETS; i++)
+		latency[i] = g_atomic_int_get((gint *)&stats->latency[i]);
+
+	g_mutex_lock(&stats->mutex);
+
+	stats_fold(stats);
+
+	// details only sources have. decimated frames would have cost about the
+	// average conversion time.
+	GString *extra = g_string_new(NULL);
+	if (stats->totals[STATS_CONVERTED] > 0) {
+		double average = stats->totals[STATS_CONVERT_TIME] / 1000.0 / stats->totals[STATS_CONVERTED];
+
+		g_string_append_printf(extra, ", convert %.2f ms/frame", average);
+		if (stats->totals[STATS_DECIMATED] > 0)
+			g_string_append_printf(extra, ", decimated %" G_GUINT64_FORMAT " frames, %.1f s saved",
+					       stats->totals[STATS_DECIMATED],
+					       stats->totals[STATS_DECIMATED] * average / 1000.0);
+	}
+	if (stats->totals[STATS_QOS_SKIPPED] > 0)
+		g_string_append_printf(extra, ", qos skipped %" G_GUINT64_FORMAT, stats->totals[STATS_QOS_SKIPPED]);
+	if (stats->totals[STATS_SUPPRESSED] > 0)
+		g_string_append_printf(extra, ", unchanged %" G_GUINT64_FORMAT, stats->totals[STATS_SUPPRESSED]);
+	if (stats->totals[STATS_THROTTLED] > 0)
+		g_string_append_printf(extra, ", throttled %" G_GUINT64_FORMAT, stats->totals[STATS_THROTTLED]);
+
+	blog(LOG_INFO,
+	     "[obs-gstreamer] %s: frames %" G_GUINT64_FORMAT ", samples %" G_GUINT64_FORMAT
+	     ", packets %" G_GUINT64_FORMAT ", %.1f kbit/s, dropped %" G_GUINT64_FORMAT
+	     ", restarts %" G_GUINT64_FORMAT ", errors %" G_GUINT64_FORMAT
+	     ", queue %d, latency p50 < %d ms, p99 < %d ms%s",
+	     name, stats->totals[STATS_FRAMES], stats->totals[STATS_SAMPLES], stats->totals[STATS_PACKETS],
+	     stats->bitrate / 1000.0, stats->totals[STATS_DROPPED], stats->totals[STATS_RESTARTS],
+	     stats->totals[STATS_ERRORS], g_atomic_int_get(&stats->queue_depth),
+	     stats_latency_percentile(latency, 0.5), stats_latency_percentile(latency, 0.99), extra->str);
+
+	g_mutex_unlock(&stats->mutex);
+
+	g_string_free(extra, TRUE);
+}
+
+// proc handler helper, returns the stats as JSON in the "stats" parameter
+void gstreamer_stats_get(gstreamer_stats_t *stats, calldata_t *cd)
+{
+	static const char *names[STATS_COUNTERS] = {
+		"frames", "samples", "packets", "bytes", "dropped",
+		"restarts", "errors", "converted", "convert_time_us", "decimated", "qos_skipped", "suppressed",
+		"throttled",
+	};
+
+	obs_data_t *obj = obs_data_create();
+
+	g_mutex_lock(&stats->mutex);
+
+	stats_fold(stats);
+
+	for (int i = 0; i < STATS_COUNTERS; i++)
+		obs_data_set_int(obj, names[i], stats->totals[i]);
+	obs_data_set_int(obj, "bitrate", stats->bitrate);
+
+	g_mutex_unlock(&stats->mutex);
+
+	obs_data_set_int(obj, "queue_depth", g_atomic_int_get(&stats->queue_depth));
+
+	obs_data_array_t *array = obs_data_array_create();
+
+	for (int i = 0; i < STATS_LATENCY_BUCKETS; i++) {
+		obs_data_t *bucket = obs_data_create();
+
+		// the last bucket is open ended
+		if (i < STATS_LATENCY_BUCKETS - 1)
+			obs_data_set_int(bucket, "below_ms", 1 << i);
+		obs_data_set_int(bucket, "count", g_atomic_int_get((gint *)&stats->latency[i]));
+
+		obs_data_array_push_back(array, bucket);
+		obs_data_release(bucket);
+	}
+
+	obs_data_set_array(obj, "latency", array);
+	obs_data_array_release(array);
+
+	calldata_set_string(cd, "stats", obs_data_get_json(obj));
+
+	obs_data_release(obj);
+}
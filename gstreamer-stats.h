@@ -0,0 +1,77 @@
+/*
+ * obs-gstreamer. OBS Studio plugin.
+ * Copyright (C) 2018-2021 Florian Zwoch <fzwoch@gmail.com>
+ *
+ * This file is part of obs-gstreamer.
+ *
+ * obs-gstreamer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * obs-gstreamer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obs-gstreamer. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GSTREAMER_STATS_H
+#define GSTREAMER_STATS_H
+
+#include <obs/obs-module.h>
+#include <gst/gst.h>
+
+// bucket n counts latencies below 2^n ms, the last one everything above
+#define STATS_LATENCY_BUCKETS 12
+
+enum stats_counter {
+	STATS_FRAMES,
+	STATS_SAMPLES,
+	STATS_PACKETS,
+	STATS_BYTES,
+	STATS_DROPPED,
+	STATS_RESTARTS,
+	STATS_ERRORS,
+	STATS_CONVERTED,
+	STATS_CONVERT_TIME, // us
+	STATS_DECIMATED,
+	STATS_QOS_SKIPPED,
+	STATS_SUPPRESSED,
+	STATS_THROTTLED,
+	STATS_COUNTERS,
+};
+
+// runtime statistics of a source, filter, encoder or output. the hot paths
+// only do atomic adds on 32 bit counters, which are folded into 64 bit totals
+// whenever the stats are read.
+typedef struct {
+	guint counters[STATS_COUNTERS];
+	guint latency[STATS_LATENCY_BUCKETS];
+	gint queue_depth;
+	gint log_time;
+
+	GMutex mutex;
+	guint folded[STATS_COUNTERS];
+	guint64 totals[STATS_COUNTERS];
+	gint64 bitrate_time;
+	guint64 bitrate_bytes;
+	guint64 bitrate;
+} gstreamer_stats_t;
+
+static inline void gstreamer_stats_add(gstreamer_stats_t *stats, enum stats_counter counter, guint n)
+{
+	g_atomic_int_add((gint *)&stats->counters[counter], n);
+}
+
+void gstreamer_stats_init(gstreamer_stats_t *stats);
+void gstreamer_stats_clear(gstreamer_stats_t *stats);
+void gstreamer_stats_latency(gstreamer_stats_t *stats, GstClockTimeDiff latency);
+bool gstreamer_stats_due(gstreamer_stats_t *stats);
+void gstreamer_stats_fold(gstreamer_stats_t *stats);
+void gstreamer_stats_log(gstreamer_stats_t *stats, const char *name);
+void gstreamer_stats_get(gstreamer_stats_t *stats, calldata_t *cd);
+
+#endif
@@ -34,6 +34,8 @@ extern obs_properties_t *gstreamer_source_get_properties(void *data);
 extern void gstreamer_source_update(void *data, obs_data_t *settings);
 extern void gstreamer_source_show(void *data);
 extern void gstreamer_source_hide(void *data);
+extern void gstreamer_source_activate(void *data);
+extern void gstreamer_source_deactivate(void *data);
 extern enum obs_media_state gstreamer_source_get_state(void *data);
 extern int64_t gstreamer_source_get_time(void *data);
 extern int64_t gstreamer_source_get_duration(void *data);
@@ -101,6 +103,8 @@ bool obs_module_load(void)
 		.update = gstreamer_source_update,
 		.show = gstreamer_source_show,
 		.hide = gstreamer_source_hide,
+		.activate = gstreamer_source_activate,
+		.deactivate = gstreamer_source_deactivate,
 
 		.media_get_state = gstreamer_source_get_state,
 		.media_get_time = gstreamer_source_get_time,
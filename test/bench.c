@@ -0,0 +1,311 @@
+/*
+ * obs-gstreamer. OBS Studio plugin.
+ * Copyright (C) 2018-2021 Florian Zwoch <fzwoch@gmail.com>
+ *
+ * This file is part of obs-gstreamer.
+ *
+ * obs-gstreamer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * obs-gstreamer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with obs-gstreamer. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// headless throughput benchmark. starts N gstreamer sources without any
+// graphics and prints one JSON line with the time creating the sources took,
+// the time until all of them delivered a frame, delivered fps, drops, CPU
+// time per frame, peak RSS, thread count and the per-frame cost of reading a
+// setting before and after the sources kept a snapshot of their settings.
+//
+// usage: obs-gstreamer-bench [sources] [seconds]
+// OBS_GSTREAMER_PLUGIN overrides the plugin path,
+// OBS_GSTREAMER_BENCH_PIPELINE the pipeline of each source.
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <obs/obs.h>
+#include <obs/util/platform.h>
+#include <assert.h>
+
+#define WARMUP_SECONDS 2
+#define READY_TIMEOUT_SECONDS 30
+#define LOOKUP_ITERATIONS 1000000
+
+static const char *default_pipeline =
+    "videotestsrc is-live=true ! video/x-raw, format=I420, framerate=30/1, width=1280, height=720 ! video. "
+    "audiotestsrc is-live=true ! audio/x-raw, channels=2, rate=48000 ! audio.";
+
+// keep stdout for the results
+static void log_handler(int level, const char *format, va_list args, void *param)
+{
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+}
+
+static long thread_count(void)
+{
+    FILE *file = fopen("/proc/self/status", "r");
+    char line[256];
+    long threads = 0;
+
+    if (file == NULL)
+        return 0;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        if (strncmp(line, "Threads:", 8) == 0)
+        {
+            threads = strtol(line + 8, NULL, 10);
+            break;
+        }
+    }
+
+    fclose(file);
+
+    return threads;
+}
+
+static double cpu_seconds(void)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+// frames and dropped frames as reported by the source's get_stats proc
+static void source_stats(obs_source_t *source, long long *frames, long long *dropped)
+{
+    calldata_t cd = {0};
+
+    *frames = 0;
+    *dropped = 0;
+
+    if (proc_handler_call(obs_source_get_proc_handler(source), "get_stats", &cd))
+    {
+        obs_data_t *stats = obs_data_create_from_json(calldata_string(&cd, "stats"));
+
+        *frames = obs_data_get_int(stats, "frames");
+        *dropped = obs_data_get_int(stats, "dropped");
+
+        obs_data_release(stats);
+    }
+
+    calldata_free(&cd);
+}
+
+// what reading a setting on the streaming threads cost per buffer before the
+// sources kept a typed snapshot of their settings
+static double settings_lookup_ns(obs_source_t *source)
+{
+    obs_data_t *settings = obs_source_get_settings(source);
+    volatile bool value = false;
+
+    uint64_t start = os_gettime_ns();
+
+    for (int i = 0; i < LOOKUP_ITERATIONS; i++)
+        value ^= obs_data_get_bool(settings, "use_timestamps_video");
+
+    uint64_t time = os_gettime_ns() - start;
+
+    obs_data_release(settings);
+
+    return time / (double)LOOKUP_ITERATIONS;
+}
+
+// the same read from a snapshot, like the appsink callbacks do it through
+// the sink's config pointer
+struct config_snapshot
+{
+    bool use_timestamps_video;
+};
+
+struct sink_snapshot
+{
+    const struct config_snapshot *volatile config;
+};
+
+static double snapshot_read_ns(obs_source_t *source)
+{
+    obs_data_t *settings = obs_source_get_settings(source);
+    struct config_snapshot config = {obs_data_get_bool(settings, "use_timestamps_video")};
+    struct sink_snapshot sink = {&config};
+    struct sink_snapshot *volatile sink_ptr = &sink;
+    volatile bool value = false;
+
+    obs_data_release(settings);
+
+    uint64_t start = os_gettime_ns();
+
+    for (int i = 0; i < LOOKUP_ITERATIONS; i++)
+        value ^= sink_ptr->config->use_timestamps_video;
+
+    uint64_t time = os_gettime_ns() - start;
+
+    return time / (double)LOOKUP_ITERATIONS;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1;
+    int seconds = argc > 2 ? atoi(argv[2]) : 10;
+
+    const char *plugin = getenv("OBS_GSTREAMER_PLUGIN");
+    if (plugin == NULL)
+        plugin = "/usr/local/lib/obs-plugins/obs-gstreamer.so";
+
+    const char *pipeline = getenv("OBS_GSTREAMER_BENCH_PIPELINE");
+    if (pipeline == NULL)
+        pipeline = default_pipeline;
+
+    assert(count > 0 && seconds > 0);
+
+    base_set_log_handler(log_handler, NULL);
+
+    obs_startup("en-US", NULL, NULL);
+
+    obs_module_t *module;
+
+    int res = obs_open_module(&module, plugin, NULL);
+    assert(res == MODULE_SUCCESS);
+    obs_init_module(module);
+
+    obs_post_load_modules();
+
+    // no obs_reset_video(), frames are delivered to OBS but never rendered
+    struct obs_audio_info audio_info = {
+        .samples_per_sec = 48000,
+        .speakers = SPEAKERS_STEREO,
+    };
+
+    obs_reset_audio(&audio_info);
+
+    obs_source_t **sources = calloc(count, sizeof(obs_source_t *));
+    long long *frames_start = calloc(count, sizeof(long long));
+    long long *dropped_start = calloc(count, sizeof(long long));
+
+    // like loading a scene collection, all sources are created in a row on
+    // one thread
+    uint64_t create_start = os_gettime_ns();
+
+    for (int i = 0; i < count; i++)
+    {
+        obs_data_t *settings = obs_data_create();
+        char name[32];
+
+        obs_data_set_string(settings, "pipeline", pipeline);
+        obs_data_set_bool(settings, "stop_on_hide", false);
+        obs_data_set_bool(settings, "no_buffer", true);
+
+        snprintf(name, sizeof(name), "bench %d", i);
+        sources[i] = obs_source_create("gstreamer-source", name, settings, NULL);
+
+        obs_data_release(settings);
+    }
+
+    uint64_t create_time = os_gettime_ns() - create_start;
+
+    uint64_t ready_time = 0;
+    for (int ready = 0; ready < count;)
+    {
+        if (os_gettime_ns() - create_start > READY_TIMEOUT_SECONDS * 1000000000ULL)
+            break;
+
+        os_sleep_ms(10);
+
+        for (ready = 0; ready < count; ready++)
+        {
+            long long frames, dropped;
+
+            source_stats(sources[ready], &frames, &dropped);
+            if (frames == 0)
+                break;
+        }
+
+        ready_time = os_gettime_ns() - create_start;
+    }
+
+    sleep(WARMUP_SECONDS);
+
+    for (int i = 0; i < count; i++)
+        source_stats(sources[i], &frames_start[i], &dropped_start[i]);
+
+    double cpu_start = cpu_seconds();
+    long threads = 0;
+
+    for (int i = 0; i < seconds; i++)
+    {
+        sleep(1);
+
+        long current = thread_count();
+        if (current > threads)
+            threads = current;
+    }
+
+    double cpu = cpu_seconds() - cpu_start;
+
+    // with the sources still running, as the lookups used to be
+    double lookup = settings_lookup_ns(sources[0]);
+    double snapshot = snapshot_read_ns(sources[0]);
+
+    long long frames_total = 0;
+    long long dropped_total = 0;
+    double fps_min = 0.0;
+
+    printf("{\"sources\": %d, \"seconds\": %d, \"create_ms\": %.1f, \"ready_ms\": %.1f, \"fps\": [", count, seconds,
+           create_time / 1000000.0, ready_time / 1000000.0);
+
+    for (int i = 0; i < count; i++)
+    {
+        long long frames, dropped;
+
+        source_stats(sources[i], &frames, &dropped);
+
+        frames -= frames_start[i];
+        dropped -= dropped_start[i];
+
+        frames_total += frames;
+        dropped_total += dropped;
+
+        double fps = frames / (double)seconds;
+        if (i == 0 || fps < fps_min)
+            fps_min = fps;
+
+        printf("%s%.2f", i > 0 ? ", " : "", fps);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("], \"fps_min\": %.2f, \"fps_avg\": %.2f, \"dropped\": %lld, \"cpu_ms_per_frame\": %.3f, "
+           "\"peak_rss_kb\": %ld, \"threads\": %ld, \"settings_lookup_ns\": %.1f, "
+           "\"snapshot_read_ns\": %.2f}\n",
+           fps_min, frames_total / (double)seconds / count, dropped_total,
+           frames_total > 0 ? cpu * 1000.0 / frames_total : 0.0, usage.ru_maxrss, threads, lookup,
+           snapshot);
+    fflush(stdout);
+
+    for (int i = 0; i < count; i++)
+        obs_source_release(sources[i]);
+
+    free(sources);
+    free(frames_start);
+    free(dropped_start);
+
+    obs_shutdown();
+
+    return frames_total > 0 ? 0 : 1;
+}